@@ -0,0 +1,276 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QIODevice>
+#include <QDebug>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+/* An event-driven (SAX-style) bencode parser. The document is scanned once, dispatching on the first byte of each value,
+ * and the structure is reported to a handler, which must provide these methods:
+ *
+ *	bool beginList(uint64_t begin);
+ *	bool beginDictionary(uint64_t begin);
+ *	bool end(uint64_t end);					- the end of the innermost open list or dictionary
+ *	bool key(QByteArrayView key, uint64_t begin);		- a dictionary key, always followed by the value for the key
+ *	bool string(QByteArrayView s, uint64_t begin);
+ *	bool integer(int64_t i, uint64_t begin, uint64_t end);
+ *
+ * All offsets are byte offsets in the document; 'begin' is the offset of the first byte of a value (for strings and keys,
+ * of the string data, past the length prefix), and 'end' is the offset just past the last byte of a value. String views
+ * point into the document. A handler method returns false to stop parsing, after reporting the reason.
+ * The document must consist of a single value, data past the end of the value is ignored. */
+template <typename Handler> class BencodeReader
+{
+private:
+	enum
+	{
+		/* The maximum nesting depth of lists and dictionaries. */
+		MAX_DEPTH	= 256,
+	};
+	static bool error(const char * message, uint64_t offset)
+	{
+		qCritical().noquote() << QString("Bencode error at offset %1: %2").arg(offset).arg(message);
+		return false;
+	}
+public:
+	static bool parse(QByteArrayView data, Handler & handler)
+	{
+		const char * const p = data.data();
+		const uint64_t size = data.size();
+		uint64_t x = 0;
+		/* The currently open lists and dictionaries; for dictionaries, also whether a key or a value comes next. */
+		struct Container { bool dictionary, expect_key; };
+		std::vector<Container> open;
+
+		do
+		{
+			if (x >= size)
+				return error("unexpected end of data", x);
+			const char c = p[x];
+			if (c == 'e')
+			{
+				if (!open.size())
+					return error("unexpected end marker", x);
+				if (open.back().dictionary && !open.back().expect_key)
+					return error("dictionary key without a value", x);
+				open.pop_back();
+				if (!handler.end(++ x))
+					return false;
+				continue;
+			}
+			bool is_key = false;
+			if (open.size() && open.back().dictionary)
+			{
+				is_key = open.back().expect_key;
+				if (is_key && !(c >= '0' && c <= '9'))
+					return error("dictionary key is not a string", x);
+				open.back().expect_key = !is_key;
+			}
+			switch (c)
+			{
+				case 'd':
+				case 'l':
+					if (open.size() == MAX_DEPTH)
+						return error("nesting too deep", x);
+					open.push_back(Container { c == 'd', true });
+					if (!(c == 'd' ? handler.beginDictionary(x) : handler.beginList(x)))
+						return false;
+					x ++;
+					break;
+				case 'i':
+				{
+					const uint64_t begin = x ++;
+					const bool negative = x < size && p[x] == '-';
+					x += negative;
+					uint64_t i = 0, digits = 0;
+					for (; x < size && p[x] >= '0' && p[x] <= '9'; x ++, digits ++)
+					{
+						if (i > (UINT64_MAX - 9) / 10)
+							return error("integer too large", x);
+						i = i * 10 + (p[x] - '0');
+					}
+					if (!digits || x >= size || p[x] != 'e' || i > (uint64_t) INT64_MAX)
+						return error("malformed integer", x);
+					x ++;
+					if (!handler.integer(negative ? - (int64_t) i : (int64_t) i, begin, x))
+						return false;
+					break;
+				}
+				default:
+				{
+					if (!(c >= '0' && c <= '9'))
+						return error("unexpected character", x);
+					uint64_t length = 0;
+					for (; x < size && p[x] >= '0' && p[x] <= '9'; x ++)
+					{
+						if (length > (UINT64_MAX - 9) / 10)
+							return error("string length too large", x);
+						length = length * 10 + (p[x] - '0');
+					}
+					if (x >= size || p[x] != ':')
+						return error("malformed string length", x);
+					x ++;
+					if (length > size - x)
+						return error("string extends past the end of data", x);
+					const QByteArrayView s(p + x, length);
+					if (!(is_key ? handler.key(s, x) : handler.string(s, x)))
+						return false;
+					x += length;
+					break;
+				}
+			}
+		}
+		while (open.size());
+		return true;
+	}
+};
+
+/* The types of bencoded values, and helpers for the strings reported by 'BencodeReader'. */
+class Bencode
+{
+public:
+	enum NodeType : uint8_t
+	{
+		STRING,
+		INTEGER,
+		LIST,
+		DICTIONARY,
+	};
+	/* Returns the string as text, if it is valid UTF-8, and as a hexadecimal string otherwise (e.g. for binary data). */
+	static QString text(QByteArrayView s)
+	{
+		QString t = QString::fromUtf8(s);
+		if (t.toUtf8().length() == s.size())
+			return t;
+		return QByteArray(s.data(), s.size()).toHex();
+	}
+	static bool equals(QByteArrayView s, const char * literal) { return (size_t) s.size() == strlen(literal) && !memcmp(s.data(), literal, s.size()); }
+};
+
+/* Writes a bencoded document in a readable form, directly from the bencode parser events - the document is not built
+ * in memory, and the output is written to the device in large chunks, as it is produced. Two formats are supported:
+ *
+ *	TEXT	- {"key" : value, ...}, [value, ...], "string", integer - the dump format of earlier versions
+ *	JSON	- standard, compact JSON; dictionaries are objects, with the keys in document order
+ *
+ * Strings which are not valid UTF-8 (e.g. the piece hashes) are written as hexadecimal strings. */
+class BencodeDumper
+{
+public:
+	enum Format { TEXT, JSON };
+private:
+	enum
+	{
+		/* The output is written to the device, whenever this much has been buffered. */
+		FLUSH_SIZE	= 64 * 1024,
+	};
+	struct Writer
+	{
+		QIODevice & device;
+		const Format format;
+		QByteArray buffer;
+		/* For each open list or dictionary - whether it is a dictionary, and whether it has no elements so far. */
+		struct Container { bool dictionary, empty; };
+		std::vector<Container> open;
+		/* Set after a dictionary key, the value then follows without a separator. */
+		bool after_key = false;
+		bool ok = true;
+
+		void flush(void)
+		{
+			if (buffer.size() && device.write(buffer) != buffer.size())
+				ok = false;
+			buffer.clear();
+		}
+		void separator(void)
+		{
+			if (after_key)
+				after_key = false;
+			else if (open.size() && !std::exchange(open.back().empty, false))
+				buffer += format == JSON ? "," : ", ";
+			if (buffer.size() >= FLUSH_SIZE)
+				flush();
+		}
+		void quoted(QByteArrayView s)
+		{
+			buffer += '"';
+			if (!isUtf8(s))
+				buffer += QByteArray(s.data(), s.size()).toHex();
+			else if (format == TEXT)
+				buffer.append(s.data(), s.size());
+			else
+				for (const char c : s)
+				{
+					if (c == '"' || c == '\\')
+						buffer += '\\';
+					if ((uchar) c >= 0x20)
+						buffer += c;
+					else
+						buffer += QByteArray("\\u00") + QByteArray::number((uchar) c, 16).rightJustified(2, '0');
+				}
+			buffer += '"';
+		}
+		bool beginList(uint64_t) { separator(); buffer += '['; open.push_back(Container { false, true }); return ok; }
+		bool beginDictionary(uint64_t) { separator(); buffer += '{'; open.push_back(Container { true, true }); return ok; }
+		bool end(uint64_t)
+		{
+			buffer += open.back().dictionary ? '}' : ']';
+			open.pop_back();
+			return ok;
+		}
+		bool key(QByteArrayView key, uint64_t)
+		{
+			separator();
+			quoted(key);
+			buffer += format == JSON ? ":" : " : ";
+			after_key = true;
+			return ok;
+		}
+		bool string(QByteArrayView s, uint64_t) { separator(); quoted(s); return ok; }
+		bool integer(int64_t i, uint64_t, uint64_t) { separator(); buffer += QByteArray::number((qint64) i); return ok; }
+	};
+public:
+	/* Returns true if the string is valid UTF-8 - without overlong encodings, surrogates, or code points above U+10FFFF. */
+	static bool isUtf8(QByteArrayView s)
+	{
+		const uchar * p = reinterpret_cast<const uchar *>(s.data()), * const end = p + s.size();
+		while (p < end)
+		{
+			if (* p < 0x80)
+			{
+				p ++;
+				continue;
+			}
+			const int length = (* p & 0xe0) == 0xc0 ? 2 : (* p & 0xf0) == 0xe0 ? 3 : (* p & 0xf8) == 0xf0 ? 4 : 0;
+			if (!length || end - p < length)
+				return false;
+			uint32_t c = * p & (0x7f >> length);
+			for (int i = 1; i < length; i ++)
+			{
+				if ((p[i] & 0xc0) != 0x80)
+					return false;
+				c = (c << 6) | (p[i] & 0x3f);
+			}
+			static const uint32_t minimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+			if (c < minimum[length] || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+				return false;
+			p += length;
+		}
+		return true;
+	}
+	/* Dumps a complete bencoded document to a device. Returns false on parse or write errors. */
+	static bool dump(QByteArrayView document, QIODevice & device, Format format)
+	{
+		Writer writer { device, format, QByteArray(), {} };
+		writer.buffer.reserve(FLUSH_SIZE + 4096);
+		if (!BencodeReader<Writer>::parse(document, writer))
+			return false;
+		writer.flush();
+		return writer.ok;
+	}
+};
@@ -3,366 +3,294 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QFile>
+#include <QByteArrayView>
 
+#include <map>
 #include <memory>
+#include <cstring>
 
-class BtString;
-class BtInteger;
-class BtList;
-class BtDictionary;
-
-class BtNode
-{
-public:
-	virtual class BtString * asString(void) { return 0; }
-	virtual class BtInteger * asInteger(void) { return 0; }
-	virtual class BtList * asList(void) { return 0; }
-	virtual class BtDictionary * asDictionary(void) { return 0; }
-	virtual const QString print(void) = 0;
-};
-
-class BtString : public BtNode
-{
-private:
-	QByteArray data;
-public:
-	class BtString * asString(void) override { return this; }
-	const QString value(void) const
-	{
-		QString s = QString::fromUtf8(data);
-		// I have no idea why I wrote this...
-		if (s.toUtf8().length() == data.length())
-			return s;
-		return data.toHex();
-	}
-	BtString(const QByteArray & data) : data(data) {}
-	const QString print(void) override { return QString("\"%1\"").arg(value()); }
-};
-class BtInteger : public BtNode
-{
-private:
-	int64_t i;
-public:
-	class BtInteger * asInteger(void) override { return this; }
-	int64_t value(void) { return i; }
-	BtInteger(int64_t i) : i(i) {}
-	const QString print(void) override { return QString("%1").arg(i); }
-};
-class BtList : public BtNode
-{
-private:
-	const QList<std::shared_ptr<BtNode>> l;
-public:
-	class BtList * asList(void) override { return this; }
-	const QList<std::shared_ptr<BtNode>> & value(void) const { return l; }
-	BtList(const QList<std::shared_ptr<BtNode>> & l) : l(l) {}
-	const QString print(void) override
-	{
-		QString s("[");
-		for (const auto & item : l)
-			s += item->print() + ", ";
-		if (s.length() > 1 && s.last(2) == ", ")
-			s.chop(2);
-		return s + ']';
-	}
-};
-class BtDictionary : public BtNode
-{
-private:
-	const QList<QPair<QString, std::shared_ptr<BtNode>>> d;
-public:
-	class BtDictionary * asDictionary(void) override { return this; }
-	const QList<QPair<QString, std::shared_ptr<BtNode>>> & value(void) const { return d; }
-	BtDictionary(const QList<QPair<QString, std::shared_ptr<BtNode>>> & d) : d(d) {}
-	const QString print(void) override
-	{
-		QString s("{");
-		for (const auto & item : d)
-			s += QString("\"%1\" : %2, ").arg(item.first).arg(item.second->print());
-		if (s.length() > 1 && s.last(2) == ", ")
-			s.chop(2);
-		return s + '}';
-	}
-};
-
-std::shared_ptr<BtNode> parseString(const QByteArray & data, int & offset)
-{
-	int x = offset;
-	if (x >= data.length())
-		return 0;
-	int len = 0;
-	while (x < data.length() && QChar(data.at(x)).isDigit())
-		len = len * 10 + QChar(data.at(x ++)).digitValue();
-	/* Is a zero-length string allowed? */
-	if (!len)
-		return 0;
-	if  (x >= data.length() || data.at(x) != ':')
-	{
-		qCritical() << __func__ << "error at offsets" << offset << x;
-		return 0;
-	}
-	QByteArray s = data.mid(x + 1, len);
-	if (s.length() != len)
-	{
-		qCritical() << __func__ << "error at offsets" << offset << x;
-		return 0;
-	}
-	offset = x + 1 + len;
-	return std::make_shared<BtString>(s);
-}
-
-std::shared_ptr<BtNode> parseInteger(const QByteArray & data, int & offset)
-{
-	int x = offset;
-	if (x >= data.length() || data.at(x) != 'i')
-		return 0;
-	x ++;
-	int64_t i = 0;
-	int sgn = 1;
-	while (x < data.length())
-	{
-		QChar c = data.at(x ++);
-		if (c.isDigit())
-			i = i * 10 + c.digitValue();
-		else if (c == '-')
-			sgn = -1;
-		else if (c == 'e')
-			break;
-		else
-		{
-			qCritical() << __func__ << "error at offsets" << offset << x;
-			return 0;
-		}
-	}
-	offset = x;
-	return std::make_shared<BtInteger>(i * sgn);
-}
-
-std::shared_ptr<BtNode> parseDictionary(const QByteArray & data, int & offset);
-
-std::shared_ptr<BtNode> parseList(const QByteArray & data, int & offset)
-{
-	int x = offset;
-	if (x >= data.length() || data.at(x) != 'l')
-		return 0;
-	x ++;
-	QList<std::shared_ptr<BtNode>> l;
-	while (1)
-	{
-		std::shared_ptr<BtNode> t;
-		if ((t = parseString(data, x)))
-			l.push_back(t);
-		else if ((t = parseInteger(data, x)))
-			l.push_back(t);
-		else if ((t = parseList(data, x)))
-			l.push_back(t);
-		else if ((t = parseDictionary(data, x)))
-			l.push_back(t);
-		else if (x < data.length() && data.at(x) == 'e')
-		{
-			offset = x + 1;
-			return std::make_shared<BtList>(l);
-		}
-		else
-		{
-			qCritical() << __func__ << "error at offsets" << offset << x;
-			return 0;
-		}
-	}
-}
-
-std::shared_ptr<BtNode> parseDictionary(const QByteArray & data, int & offset)
-{
-	int x = offset;
-	if (x >= data.length() || data.at(x) != 'd')
-		return 0;
-	x ++;
-	QList<QPair<QString, std::shared_ptr<BtNode>>> d;
-	while (1)
-	{
-		QString key;
-		std::shared_ptr<BtNode> value;
-
-		if (x < data.length() && data.at(x) == 'e')
-		{
-			offset = x + 1;
-			return std::make_shared<BtDictionary>(d);
-		}
-
-		if (!(value = parseString(data, x)))
-			return 0;
-		key = value->asString()->value();
-
-		if ((value = parseString(data, x)))
-			d.push_back(QPair<QString, std::shared_ptr<BtNode>>(key, value));
-		else if ((value = parseInteger(data, x)))
-			d.push_back(QPair<QString, std::shared_ptr<BtNode>>(key, value));
-		else if ((value = parseList(data, x)))
-			d.push_back(QPair<QString, std::shared_ptr<BtNode>>(key, value));
-		else if ((value = parseDictionary(data, x)))
-			d.push_back(QPair<QString, std::shared_ptr<BtNode>>(key, value));
-		else
-		{
-			qCritical() << __func__ << "error at offset" << offset << x;
-			return 0;
-		}
-	}
-}
-
+#include "Bencode.hxx"
+#include "MerkleTree.hxx"
+#include "Sha1.hxx"
 
+/* A torrent file. The torrent details are read in a single streaming pass over the torrent file, see 'TorrentInfoReader'
+ * below, without building a tree of the bencoded values. To dump the complete contents of the torrent file, use 'dump()'. */
 class BitTorrent
 {
 	Q_DECLARE_TR_FUNCTIONS(BitTorrent)
 private:
 
-	bool process_files_dictionary_entry(const std::shared_ptr<BtNode> entry)
+	/* Fills in the torrent details directly from the bencode parser events, in a single pass over the torrent file,
+	 * without building a tree. Only the values needed for verification are extracted, everything else is skipped.
+	 * Also records the span of the 'info' dictionary in the torrent file, for computing the info-hash.
+	 * Both the v1 ('pieces', 'files') and the v2 ('file tree', root level 'piece layers') structures are read,
+	 * so that hybrid torrents can be verified either way. */
+	struct TorrentInfoReader
 	{
-		if (!entry->asDictionary())
-			return false;
+		enum Context { ROOT, INFO, FILES, FILE_ENTRY, PATH, FILE_TREE, FILE_TREE_ENTRY, PIECE_LAYERS, SKIPPED };
+		BitTorrent & torrent;
+		/* The contexts of the currently open lists and dictionaries. */
+		std::vector<Context> open;
+		/* The last key seen in the innermost open dictionary. */
+		QByteArrayView current_key;
+		bool info_found = false;
+		uint64_t info_begin = 0, info_end = 0;
+		/* The 'files' entry being read. */
 		QStringList path;
 		int64_t length = -1;
-		for (const auto & item : entry->asDictionary()->value())
+		QString md5sum;
+		bool padding = false;
+		/* The path of the 'file tree' node being read, and the 'pieces root' of the v2 file being read. */
+		QStringList tree_path;
+		QByteArray pieces_root;
+
+		TorrentInfoReader(BitTorrent & torrent) : torrent(torrent) {}
+		bool fail(const char * message) { qCritical() << message; return false; }
+		/* Returns the MD5 hash of an 'md5sum' key, as a lowercase hex string. The key should hold the hash as a hex string,
+		 * but some torrent makers store the raw digest. An invalid hash is reported, and ignored. */
+		static QString md5sumText(QByteArrayView s)
 		{
-			if (item.first == "path" && item.second->asList())
+			if (s.size() == 16)
+				return QString(QByteArray(s.data(), s.size()).toHex());
+			const QString md5sum = Bencode::text(s).toLower();
+			bool valid = md5sum.length() == 32;
+			for (const auto & c : md5sum)
+				valid = valid && (('0' <= c && c <= '9') || ('a' <= c && c <= 'f'));
+			if (!valid)
+				qCritical() << "Ignoring an invalid 'md5sum' key in the torrent:" << Bencode::text(s);
+			return valid ? md5sum : QString();
+		}
+		bool keyIs(const char * key) const { return Bencode::equals(current_key, key); }
+		/* Called for the key/value pairs in the 'info' dictionary. */
+		bool infoValue(Bencode::NodeType type, QByteArrayView s, int64_t i)
+		{
+			TorrentDetails & details = torrent.torrent_details;
+			if (keyIs("files"))
+			{
+				if (type != Bencode::LIST)
+					return fail("Could not process the 'files' entry as a list.");
+				open.push_back(FILES);
+			}
+			else if (keyIs("length") && type == Bencode::INTEGER)
+				details.length = i;
+			else if (keyIs("name") && type == Bencode::STRING)
+				details.name = Bencode::text(s);
+			else if (keyIs("piece length") && type == Bencode::INTEGER)
+				details.piece_length = i;
+			else if (keyIs("md5sum") && type == Bencode::STRING)
+				details.md5sum = md5sumText(s);
+			else if (keyIs("meta version") && type == Bencode::INTEGER)
+				details.meta_version = i;
+			else if (keyIs("file tree"))
+			{
+				if (type != Bencode::DICTIONARY)
+					return fail("Could not process the 'file tree' entry as a dictionary.");
+				open.push_back(FILE_TREE);
+			}
+			else if (keyIs("pieces") && type == Bencode::STRING)
 			{
-				for (const auto & path_item : item.second->asList()->value())
+				details.piece_sha1_hashes = QByteArray(s.data(), s.size());
+				if (details.piece_sha1_hashes.length() % SHA1_CHECKSUM_BYTESIZE)
 				{
-					if (!path_item->asString())
-						return false;
-					path << path_item->asString()->value();
+					qCritical() << "Bad torrent hashes string, not a multiple of" << SHA1_CHECKSUM_BYTESIZE << ".";
+					return false;
 				}
 			}
-			else if (item.first == "length" && item.second->asInteger())
-				length = item.second->asInteger()->value();
-		}
-		if (!path.size() || length == -1)
-			return false;
-		torrent_details.files << TorrentDetails::file_info(path, length);
-		return true;
-	}
-	bool process_file_info_dictionary(const std::shared_ptr<BtNode> root)
-	{
-		BtDictionary * d;
-		if (!(d = root->asDictionary()))
-		{
-			qCritical() << "Could not process the torrent root node as a dictionary.";
-			return false;
-		}
-		std::shared_ptr<BtNode> info_dictionary;
-		for (const auto & item : d->value())
-		{
-			if (item.first == "info")
-				info_dictionary = item.second;
-		}
-		if (!info_dictionary.get() || !info_dictionary->asDictionary())
-		{
-			qCritical() << "Could not find the 'info' dictionary entry in torrent.";
-			return false;
+			/* Any other key (e.g. 'private', 'source', 'name.utf-8') is not needed for verification, and is skipped. */
+			else if (type == Bencode::LIST || type == Bencode::DICTIONARY)
+				open.push_back(SKIPPED);
+			return true;
 		}
-		for (const auto & item : info_dictionary->asDictionary()->value())
+		/* Called for every value in the torrent file. */
+		bool value(Bencode::NodeType type, uint64_t begin, QByteArrayView s = QByteArrayView(), int64_t i = 0)
 		{
-			if (item.first == "files")
+			const bool container = type == Bencode::LIST || type == Bencode::DICTIONARY;
+			if (!open.size())
 			{
-				BtList * l = item.second->asList();
-				if (!l)
-				{
-					qCritical() << "Could not process the 'files' entry as a list.";
-					return false;
-				}
-				for (const auto & item : l->value())
-					if (!process_files_dictionary_entry(item))
+				if (type != Bencode::DICTIONARY)
+					return fail("Could not process the torrent root node as a dictionary.");
+				open.push_back(ROOT);
+				return true;
+			}
+			switch (open.back())
+			{
+				case ROOT:
+					if (keyIs("info") && type == Bencode::DICTIONARY && !info_found)
+					{
+						info_found = true;
+						info_begin = begin;
+						open.push_back(INFO);
+					}
+					else if (keyIs("piece layers") && type == Bencode::DICTIONARY)
+						open.push_back(PIECE_LAYERS);
+					else if (container)
+						open.push_back(SKIPPED);
+					return true;
+				case INFO:
+					return infoValue(type, s, i);
+				case FILES:
+					if (type != Bencode::DICTIONARY)
+						return fail("Could not process a 'files' entry dictionary.");
+					path.clear();
+					length = -1;
+					md5sum.clear();
+					padding = false;
+					open.push_back(FILE_ENTRY);
+					return true;
+				case FILE_ENTRY:
+					if (keyIs("path") && type == Bencode::LIST)
+						open.push_back(PATH);
+					else if (keyIs("length") && type == Bencode::INTEGER)
+						length = i;
+					else if (keyIs("md5sum") && type == Bencode::STRING)
+						md5sum = md5sumText(s);
+					else if (keyIs("attr") && type == Bencode::STRING)
+						padding = QByteArray(s.data(), s.size()).contains('p');
+					else if (container)
+						open.push_back(SKIPPED);
+					return true;
+				case PATH:
+					if (type != Bencode::STRING)
+						return fail("Could not process a 'files' entry dictionary.");
+					path << Bencode::text(s);
+					return true;
+				case FILE_TREE:
+					if (type != Bencode::DICTIONARY)
+						return fail("Could not process a 'file tree' entry as a dictionary.");
+					/* The empty key holds the properties of a file, any other key is a file or directory name. */
+					if (current_key.size())
+					{
+						tree_path << Bencode::text(current_key);
+						open.push_back(FILE_TREE);
+					}
+					else
 					{
-						qCritical() << "Could not process a 'files' entry dictionary.";
-						return false;
+						length = -1;
+						pieces_root.clear();
+						open.push_back(FILE_TREE_ENTRY);
 					}
+					return true;
+				case FILE_TREE_ENTRY:
+					if (keyIs("length") && type == Bencode::INTEGER)
+						length = i;
+					else if (keyIs("pieces root") && type == Bencode::STRING)
+						pieces_root = QByteArray(s.data(), s.size());
+					else if (container)
+						open.push_back(SKIPPED);
+					return true;
+				case PIECE_LAYERS:
+					if (type != Bencode::STRING || current_key.size() != MerkleTree::HASH_SIZE || s.size() % MerkleTree::HASH_SIZE)
+						return fail("Could not process a 'piece layers' entry.");
+					torrent.piece_layers[QByteArray(current_key.data(), current_key.size())] = QByteArray(s.data(), s.size());
+					return true;
+				case SKIPPED:
+					if (container)
+						open.push_back(SKIPPED);
+					return true;
 			}
-			else if (item.first == "length" && item.second->asInteger())
-				torrent_details.length = item.second->asInteger()->value();
-			else if (item.first == "name" && item.second->asString())
-				torrent_details.name = item.second->asString()->value();
-			else if (item.first == "piece length" && item.second->asInteger())
-				torrent_details.piece_length = item.second->asInteger()->value();
-			else if (item.first == "pieces" && item.second->asString())
-			{
-				torrent_details.piece_sha1_hashes = item.second->asString()->value();
-				if (torrent_details.piece_sha1_hashes.length() % SHA1_CHECKSUM_BYTESIZE)
-				{
-					qCritical() << "Bad torrent hashes string, not a multiple of" << SHA1_CHECKSUM_BYTESIZE << ".";
-					return false;
-				}
+			return true;
+		}
 
+		bool beginList(uint64_t begin) { return value(Bencode::LIST, begin); }
+		bool beginDictionary(uint64_t begin) { return value(Bencode::DICTIONARY, begin); }
+		bool end(uint64_t end)
+		{
+			const Context context = open.back();
+			open.pop_back();
+			if (context == INFO)
+				info_end = end;
+			else if (context == FILE_ENTRY)
+			{
+				if (!path.size() || length == -1)
+					return fail("Could not process a 'files' entry dictionary.");
+				torrent.torrent_details.files << TorrentDetails::file_info(path, length, md5sum);
+				torrent.torrent_details.files.last().padding = padding;
 			}
-			else
+			else if (context == FILE_TREE && open.back() == FILE_TREE)
+				tree_path.removeLast();
+			else if (context == FILE_TREE_ENTRY)
 			{
-				/*! \todo	Resolve this - what is the 'name.utf-8' key supposed to mean?!?!
-				 * 		Ignore for the time being, time is getting short... */
-				if (item.first == "name.utf-8")
-					qCritical() << "!!! HANDLE THE 'name.utf-8' KEY (WHAT IS THIS???) !!!\nIgnore this now, time is getting short...";
-				else if (item.first == "md5sum")
-					qCritical() << "Handle the" << item.first << "key, ignoring now.";
-				else
-				{
-					qCritical() << "Unrecognized key in the torrent 'info' dictionary:" << item.first;
-					return false;
-				}
+				if (!tree_path.size() || length == -1 || (length && pieces_root.size() != MerkleTree::HASH_SIZE))
+					return fail("Could not process a 'file tree' entry.");
+				torrent.torrent_details.v2_files << TorrentDetails::v2_file_info { tree_path, length, pieces_root };
 			}
+			return true;
 		}
+		bool key(QByteArrayView key, uint64_t) { current_key = key; return true; }
+		bool string(QByteArrayView s, uint64_t begin) { return value(Bencode::STRING, begin, s); }
+		bool integer(int64_t i, uint64_t begin, uint64_t) { return value(Bencode::INTEGER, begin, QByteArrayView(), i); }
+	};
 
+	bool process_file_info(const QByteArray & data)
+	{
+		TorrentInfoReader reader(* this);
+		if (!BencodeReader<TorrentInfoReader>::parse(data, reader))
+			return false;
+		if (!reader.info_found)
+		{
+			qCritical() << "Could not find the 'info' dictionary entry in torrent.";
+			return false;
+		}
+		const QByteArrayView info(data.constData() + reader.info_begin, reader.info_end - reader.info_begin);
+		torrent_details.info_hash = Sha1::hash(info);
+
+		const bool v1 = torrent_details.piece_sha1_hashes.length()
+				&& !((torrent_details.length == -1 && !torrent_details.files.length())
+					|| (torrent_details.length != -1 && torrent_details.files.length()));
+		const bool v2 = torrent_details.meta_version == 2 && torrent_details.v2_files.length()
+				&& torrent_details.piece_length >= MerkleTree::LEAF_SIZE
+				&& torrent_details.piece_length == (int64_t) MerkleTree::powerOfTwo(torrent_details.piece_length);
 		if (		0
 				|| !torrent_details.name.length()
 				|| torrent_details.piece_length == -1
-				|| !torrent_details.piece_sha1_hashes.length()
-				|| (
-					(torrent_details.length == -1 && !torrent_details.files.length())
-					|| (torrent_details.length != -1 && torrent_details.files.length())
-					)
+				|| !(v1 || v2)
+				|| (torrent_details.meta_version == 2 && !v2)
 				)
 		{
 			qCritical() << "Could not process torrent file:" << torrent_file_name;
 			return false;
 		}
-		return true;
-	}
-#if 0
-	void extract_file_data(const std::shared_ptr<BtNode> node)
-	{
-		BtDictionary * d;
-		if (!(d = node->asDictionary()))
-			return;
-		for (const auto & item : d->value())
+		if (!v2)
 		{
-			if (item.first == "info")
-				extract_file_data(item.second);
-			else if (item.first == "files")
-			{
-				BtList * l = item.second->asList();
-				if (!l)
-					continue;
-				for (const auto & item : l->value())
-					extract_file_data(item);
-			}
-			else if (item.first == "length" && item.second->asInteger())
-				torrent_details.length = item.second->asInteger()->value();
-			else if (item.first == "name" && item.second->asString())
-				torrent_details.name = item.second->asString()->value();
-			else if (item.first == "piece length" && item.second->asInteger())
-				torrent_details.piece_length = item.second->asInteger()->value();
-			else if (item.first == "pieces" && item.second->asString())
-				torrent_details.piece_hashes = item.second->asString()->value();
+			torrent_details.v2_files.clear();
+			return true;
 		}
+		torrent_details.info_hash_v2 = MerkleTree::hash(info);
+		if (!v1)
+		{
+			/* A v2-only torrent - describe its files as a v1 torrent would, for everything that only needs
+			 * the list of files. A single file named as the torrent is stored as in a v1 single-file torrent. */
+			torrent_details.piece_sha1_hashes.clear();
+			torrent_details.files.clear();
+			torrent_details.length = -1;
+			if (torrent_details.v2_files.length() == 1 && torrent_details.v2_files.at(0).path == QStringList(torrent_details.name))
+				torrent_details.length = torrent_details.v2_files.at(0).length;
+			else
+				for (const auto & f : torrent_details.v2_files)
+					torrent_details.files << TorrentDetails::file_info(f.path, f.length);
+		}
+		return true;
 	}
-#endif
 	const QString torrent_file_name;
 public:
 
 	enum
 	{
-		SHA1_CHECKSUM_BYTESIZE	= 40 /* 160 bits ---> 20 bytes * 2 hex characters = 40 bytes */
+		SHA1_CHECKSUM_BYTESIZE	= 20 /* 160 bits ---> 20 bytes */
 	};
 
 	struct TorrentDetails
 	{
-		struct file_info { QStringList path; int64_t length; file_info(const QStringList & path, int64_t length) : path(path), length(length) {}};
+		struct file_info
+		{
+			QStringList path; int64_t length;
+			/* The MD5 hash of the file from the (optional) 'md5sum' key, as a lowercase hex string, or empty. */
+			QString md5sum;
+			/* A padding file of a hybrid torrent ('attr' contains 'p'), which aligns the next file to a piece boundary.
+			 * The data of padding files is all zeros, and is not stored. */
+			bool padding = false;
+			file_info(const QStringList & path, int64_t length, const QString & md5sum = QString()) : path(path), length(length), md5sum(md5sum) {}
+		};
 		QList<struct file_info> files;
 		/* Note: there are two cases, depending on if the torrent contains a single file, or a list of files.
 		 *
@@ -379,14 +307,50 @@ public:
 		QString name;
 		int64_t piece_length = -1;
 		int64_t length = -1;
-		QString piece_sha1_hashes;
+		/* For a single-file torrent - the MD5 hash of the file from the (optional) 'md5sum' key, as a lowercase hex string, or empty. */
+		QString md5sum;
+		/* The raw SHA1 digests of all pieces, SHA1_CHECKSUM_BYTESIZE bytes per piece, indexed by piece number.
+		 * Use the 'pieceCount()', 'pieceHash()' and 'pieceHashMatches()' accessors below. */
+		QByteArray piece_sha1_hashes;
+		/* The raw SHA1 digest of the 'info' dictionary, exactly as it is encoded in the torrent file - the torrent info-hash. */
+		QByteArray info_hash;
+
+		/* BitTorrent v2 (BEP 52) - only set for v2 and hybrid torrents, with 'meta version' 2. The v2 files are listed
+		 * in the order of the 'file tree', with their path relative to the torrent directory (or, for a single file named
+		 * as the torrent, the file name), and with the root of the SHA-256 Merkle tree of the file (empty for empty files). */
+		int64_t meta_version = 1;
+		struct v2_file_info { QStringList path; int64_t length; QByteArray pieces_root; };
+		QList<struct v2_file_info> v2_files;
+		/* The raw SHA-256 digest of the 'info' dictionary - the v2 info-hash. */
+		QByteArray info_hash_v2;
 	}
 	torrent_details;
+	/* The piece layers of the v2 files, which are larger than one piece, indexed by the 'pieces root' of the file. */
+	std::map<QByteArray, QByteArray> piece_layers;
+	/* For torrents loaded from a metadata catalog - the catalog, which holds the piece digests, and must be kept mapped. */
+	std::shared_ptr<const void> metadata_storage;
+
+	bool hasV1Hashes(void) const { return pieceCount() > 0; }
+	bool hasV2Hashes(void) const { return torrent_details.v2_files.length() > 0; }
+
+	int64_t pieceCount(void) const { return torrent_details.piece_sha1_hashes.length() / SHA1_CHECKSUM_BYTESIZE; }
+	/* Returns the raw, SHA1_CHECKSUM_BYTESIZE bytes long, SHA1 digest of a piece. */
+	QByteArrayView pieceHash(int64_t piece_index) const
+	{
+		return QByteArrayView(torrent_details.piece_sha1_hashes.constData() + piece_index * SHA1_CHECKSUM_BYTESIZE, SHA1_CHECKSUM_BYTESIZE);
+	}
+	/* Compares a raw SHA1 digest to the expected digest of a piece. */
+	bool pieceHashMatches(int64_t piece_index, QByteArrayView sha1_digest) const
+	{
+		return sha1_digest.size() == SHA1_CHECKSUM_BYTESIZE
+				&& !memcmp(torrent_details.piece_sha1_hashes.constData() + piece_index * SHA1_CHECKSUM_BYTESIZE, sha1_digest.data(), SHA1_CHECKSUM_BYTESIZE);
+	}
 
 
 public:
 	BitTorrent(const QString & torrent_file_name) : torrent_file_name(torrent_file_name) {}
 
+	/* Extracts the torrent details, in a single pass over the torrent file. */
 	bool parse(void)
 	{
 		QFile f(torrent_file_name);
@@ -396,27 +360,21 @@ public:
 			return false;
 		}
 		const QByteArray data = f.readAll();
-		int offset = 0;
-		const std::shared_ptr<BtNode> root = parseDictionary(data, offset);
-
-
-		if (root.get())
-		{
-//#ifdef BITTORRENT_DEBUG
-			QFile f("torrent-dump.txt");
-			f.open(QFile::WriteOnly);
-			QString s = root->print();
-			f.write(s.toLocal8Bit());
-			//qInfo() << "Torrent data:" << s;
-//#endif
-		}
-		else
+		if (!process_file_info(data))
 			return false;
+		return true;
+	}
 
-		//extract_file_data(root);
-		if (!process_file_info_dictionary(root))
+	/* Dumps the complete contents of the torrent file to a device, see 'BencodeDumper'. */
+	bool dump(QIODevice & device, BencodeDumper::Format format) const
+	{
+		QFile f(torrent_file_name);
+		if (!f.open(QFile::ReadOnly))
+		{
+			qCritical() << tr("Failed to open torrent file for reading:") << torrent_file_name;
 			return false;
-		return true;
+		}
+		return BencodeDumper::dump(f.readAll(), device, format);
 	}
 
 };
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QFile>
+#include <QStringList>
+#include <QDebug>
+
+#include <map>
+#include <mutex>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+/* A checkpoint journal for long verification runs, so that an interrupted run can be resumed
+ * without verifying again what has already been verified.
+ *
+ * The journal is a text file, which is only ever appended to, one tab-separated record per line:
+ *
+ *	data-directory	<directory>
+ *	torrent		<torrent index>	<torrent file name>		- verification of a torrent has started
+ *	progress	<torrent index>	<piece index>			- all pieces before the piece index have been verified
+ *	failure		<torrent index>	sha1|sha256|md5	<file name>	- a corrupted file has been found
+ *	done		<torrent index>	ok|error			- verification of a torrent has completed
+ *
+ * The journal is flushed to disk at each checkpoint, and when a torrent completes. A partially written last line
+ * (e.g. after a power loss) is ignored when the journal is loaded. Several torrents may be in progress at the same
+ * time, when torrents are verified concurrently. */
+class CheckpointJournal
+{
+public:
+	enum
+	{
+		/* How often progress is recorded while a torrent is being verified. */
+		CHECKPOINT_INTERVAL_MS	= 10 * 1000,
+	};
+	struct TorrentState
+	{
+		QString torrent_file;
+		bool done = false;
+		bool ok = false;
+		/* The first piece that has not been verified yet. */
+		int64_t next_piece = 0;
+		QStringList sha1_failures, sha256_failures, md5_failures;
+	};
+private:
+	QFile journal;
+	std::mutex mutex;
+	/* The number of failures already written to the journal, for each torrent. */
+	struct WrittenFailures
+	{
+		int sha1 = 0, sha256 = 0, md5 = 0;
+	};
+	std::map<int, WrittenFailures> written_failures;
+
+	void append(const QStringList & fields)
+	{
+		journal.write((fields.join('\t') + '\n').toUtf8());
+	}
+	void sync(void)
+	{
+		journal.flush();
+#ifdef Q_OS_UNIX
+		fdatasync(journal.handle());
+#endif
+	}
+	void appendFailures(int index, const QStringList & sha1_failures, const QStringList & sha256_failures, const QStringList & md5_failures)
+	{
+		WrittenFailures & written = written_failures[index];
+		for (; written.sha1 < sha1_failures.length(); written.sha1 ++)
+			append(QStringList() << "failure" << QString::number(index) << "sha1" << sha1_failures.at(written.sha1));
+		for (; written.sha256 < sha256_failures.length(); written.sha256 ++)
+			append(QStringList() << "failure" << QString::number(index) << "sha256" << sha256_failures.at(written.sha256));
+		for (; written.md5 < md5_failures.length(); written.md5 ++)
+			append(QStringList() << "failure" << QString::number(index) << "md5" << md5_failures.at(written.md5));
+	}
+public:
+	/* Reads the state of all torrents recorded in a journal. */
+	static bool load(const QString & fileName, QString & data_directory, std::map<int, TorrentState> & states)
+	{
+		QFile f(fileName);
+		if (!f.open(QFile::ReadOnly))
+		{
+			qCritical() << "Can not open checkpoint journal for reading:" << fileName;
+			return false;
+		}
+		const QByteArray data = f.readAll();
+		/* Ignore an incomplete last line. */
+		const QStringList lines = QString::fromUtf8(data.left(data.lastIndexOf('\n') + 1)).split('\n');
+		for (const auto & line : lines)
+		{
+			const QStringList fields = line.split('\t');
+			bool ok = fields.length() >= 2;
+			if (ok && fields.at(0) == "data-directory")
+			{
+				data_directory = fields.at(1);
+				continue;
+			}
+			const int index = ok ? fields.at(1).toInt(& ok) : -1;
+			if (!ok)
+				continue;
+			TorrentState & state = states[index];
+			if (fields.at(0) == "torrent" && fields.length() == 3)
+				state.torrent_file = fields.at(2);
+			else if (fields.at(0) == "progress" && fields.length() == 3)
+				state.next_piece = std::max(state.next_piece, (int64_t) fields.at(2).toLongLong());
+			else if (fields.at(0) == "failure" && fields.length() == 4)
+			{
+				QStringList & failures = fields.at(2) == "md5" ? state.md5_failures : fields.at(2) == "sha256" ? state.sha256_failures : state.sha1_failures;
+				if (!failures.contains(fields.at(3)))
+					failures << fields.at(3);
+			}
+			else if (fields.at(0) == "done" && fields.length() == 3)
+			{
+				state.done = true;
+				state.ok = fields.at(2) == "ok";
+			}
+		}
+		return true;
+	}
+
+	/* Opens the journal for appending. When resuming, 'states' are the torrent states loaded from the same journal. */
+	bool open(const QString & fileName, const QString & data_directory, const std::map<int, TorrentState> & states = std::map<int, TorrentState>())
+	{
+		journal.setFileName(fileName);
+		if (!journal.open(QFile::WriteOnly | QFile::Append))
+		{
+			qCritical() << "Can not open checkpoint journal for writing:" << fileName;
+			return false;
+		}
+		for (const auto & s : states)
+			written_failures[s.first] = WrittenFailures { (int) s.second.sha1_failures.length(), (int) s.second.sha256_failures.length(), (int) s.second.md5_failures.length() };
+		/* Terminate an incomplete last line, which has been ignored when loading the journal. */
+		QFile existing(fileName);
+		if (existing.open(QFile::ReadOnly) && existing.size() && existing.seek(existing.size() - 1) && existing.read(1) != "\n")
+			journal.write("\n");
+		if (!states.size())
+			append(QStringList() << "data-directory" << data_directory);
+		sync();
+		return true;
+	}
+	const QString fileName(void) const { return journal.fileName(); }
+
+	void started(int index, const QString & torrent_file)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		append(QStringList() << "torrent" << QString::number(index) << torrent_file);
+		journal.flush();
+	}
+	void progress(int index, int64_t next_piece, const QStringList & sha1_failures, const QStringList & sha256_failures, const QStringList & md5_failures)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		appendFailures(index, sha1_failures, sha256_failures, md5_failures);
+		append(QStringList() << "progress" << QString::number(index) << QString::number(next_piece));
+		sync();
+	}
+	void finished(int index, bool ok, const QStringList & sha1_failures, const QStringList & sha256_failures, const QStringList & md5_failures)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		appendFailures(index, sha1_failures, sha256_failures, md5_failures);
+		append(QStringList() << "done" << QString::number(index) << (ok ? "ok" : "error"));
+		sync();
+	}
+};
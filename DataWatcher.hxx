@@ -0,0 +1,136 @@
+#pragma once
+
+#include <QDebug>
+#include <QString>
+
+#include <unordered_map>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* Watches a directory tree for data files, which have been written to, with the Linux inotify interface.
+ *
+ * A file is reported as changed when it is closed after having been opened for writing, and when it is moved into
+ * the tree. New subdirectories are watched as soon as they are created; as files may already have been written
+ * to a new subdirectory before it is watched, all files found in a new subdirectory are reported as changed, too.
+ * If the kernel event queue overflows, events have been lost, and this is reported, so that the caller can fall back
+ * to checking everything. */
+class DataWatcher
+{
+private:
+	int fd = -1;
+	/* The watched directories, by watch descriptor. */
+	std::unordered_map<int, QString> directories;
+
+#ifdef Q_OS_LINUX
+	/* Watches a directory and all its subdirectories. If 'files' is specified, the files found are added to it. */
+	bool addDirectory(const QString & path, std::vector<QString> * files)
+	{
+		const int wd = inotify_add_watch(fd, path.toLocal8Bit().constData(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+		if (wd == -1)
+		{
+			/* The directory may have been removed again, before it could be watched. */
+			if (errno == ENOENT)
+				return true;
+			qCritical().noquote() << "Can not watch directory" << path << (errno == ENOSPC ?
+					"- the limit of inotify watches has been reached, see /proc/sys/fs/inotify/max_user_watches" : "");
+			return false;
+		}
+		directories[wd] = path;
+		DIR * directory = opendir(path.toLocal8Bit().constData());
+		if (!directory)
+			return true;
+		bool result = true;
+		struct dirent * entry;
+		while (result && (entry = readdir(directory)))
+		{
+			const QString name = QString::fromLocal8Bit(entry->d_name);
+			if (name == "." || name == "..")
+				continue;
+			if (entry->d_type == DT_DIR)
+				result = addDirectory(path + '/' + name, files);
+			else if (files && entry->d_type == DT_REG)
+				files->push_back(path + '/' + name);
+		}
+		closedir(directory);
+		return result;
+	}
+#endif
+public:
+	~DataWatcher()
+	{
+#ifdef Q_OS_LINUX
+		if (fd != -1)
+			::close(fd);
+#endif
+	}
+
+	/* Starts watching a directory tree. */
+	bool start(const QString & path)
+	{
+#ifdef Q_OS_LINUX
+		if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+		{
+			qCritical() << "Can not initialize inotify.";
+			return false;
+		}
+		return addDirectory(path, 0);
+#else
+		Q_UNUSED(path)
+		qCritical() << "Watching the torrent data directory is only supported on Linux.";
+		return false;
+#endif
+	}
+	size_t directoryCount(void) const { return directories.size(); }
+
+	/* Waits for up to 'timeout_ms' milliseconds (-1 - indefinitely) for changes, and returns the changed files.
+	 * 'overflowed' is set if events have been lost. */
+	std::vector<QString> wait(int timeout_ms, bool & overflowed)
+	{
+		std::vector<QString> files;
+		overflowed = false;
+#ifdef Q_OS_LINUX
+		struct pollfd p = { fd, POLLIN, 0 };
+		if (poll(& p, 1, timeout_ms) <= 0)
+			return files;
+		alignas(struct inotify_event) char buffer[64 * 1024];
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof buffer)) > 0)
+			for (ssize_t offset = 0; offset < length; )
+			{
+				const struct inotify_event * event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+				offset += sizeof(struct inotify_event) + event->len;
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					overflowed = true;
+					continue;
+				}
+				if (event->mask & IN_IGNORED)
+				{
+					directories.erase(event->wd);
+					continue;
+				}
+				const auto directory = directories.find(event->wd);
+				if (directory == directories.end() || !event->len)
+					continue;
+				const QString path = directory->second + '/' + QString::fromLocal8Bit(event->name);
+				if (event->mask & IN_ISDIR)
+				{
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+						addDirectory(path, & files);
+				}
+				else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+					files.push_back(path);
+			}
+#else
+		Q_UNUSED(timeout_ms)
+#endif
+		return files;
+	}
+};
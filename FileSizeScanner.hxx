@@ -0,0 +1,205 @@
+#pragma once
+
+#include <QDir>
+#include <QFileInfo>
+#include <QString>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Metrics.hxx"
+
+/* Checks the existence, type and size of a large number of files - e.g. all data files of all torrents to be checked
+ * with '--check-size-only' - in bulk, and concurrently.
+ *
+ * On network-backed, or cold-cache, filesystems, checking millions of files one blocking 'stat()' at a time is bound
+ * by the latency of each request, so the files are instead sorted by directory, and checked from a pool of threads.
+ * Each directory is listed once, with 'getdents64()' on Linux, so that missing files and subdirectories are found from
+ * the listing, without a failing 'stat()' for each; only the files present in the listing are then checked,
+ * with 'statx()', for their type and size. */
+class FileSizeScanner
+{
+public:
+	enum
+	{
+		DEFAULT_THREAD_COUNT	= 32,
+		/* The number of files checked at a time by a scanning thread. */
+		STAT_BATCH_SIZE		= 64,
+	};
+	enum Status : uint8_t
+	{
+		/* Not checked yet. */
+		PENDING,
+		/* The file does not exist, or can not be checked. */
+		MISSING,
+		/* The path exists, but is not a regular file. */
+		NOT_A_FILE,
+		/* A regular file, 'size' is its size. */
+		REGULAR_FILE,
+	};
+	struct Entry
+	{
+		QString directory;
+		QString name;
+		Status status = PENDING;
+		uint64_t size = 0;
+	};
+private:
+	/* Sorted by directory and name, without duplicates. */
+	std::vector<Entry> entries;
+	/* The first entry of each directory, and a final index past the last entry. */
+	std::vector<size_t> directories;
+
+	static bool less(const Entry & a, const Entry & b)
+	{
+		const int c = a.directory.compare(b.directory);
+		return c < 0 || (!c && a.name < b.name);
+	}
+	static Entry entryFor(const QString & path)
+	{
+		const int slash = path.lastIndexOf('/');
+		Entry entry;
+		entry.directory = slash < 0 ? QString(".") : path.left(std::max(slash, 1));
+		entry.name = path.mid(slash + 1);
+		return entry;
+	}
+
+	/* Lists a directory, and marks its entries, which are missing from the listing, or are directories. */
+	void listDirectory(size_t first, size_t last)
+	{
+		/* The names in the directory, with their type, if known. */
+		std::unordered_map<std::string, unsigned char> listing;
+#ifdef Q_OS_LINUX
+		const int fd = ::open(entries.at(first).directory.toLocal8Bit().constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			for (size_t i = first; i < last; i ++)
+				entries[i].status = MISSING;
+			return;
+		}
+		struct linux_dirent64
+		{
+			uint64_t	d_ino;
+			int64_t		d_off;
+			unsigned short	d_reclen;
+			unsigned char	d_type;
+			char		d_name[];
+		};
+		alignas(linux_dirent64) char buffer[64 * 1024];
+		long length;
+		while ((length = syscall(SYS_getdents64, fd, buffer, sizeof buffer)) > 0)
+			for (long offset = 0; offset < length; )
+			{
+				const linux_dirent64 * d = reinterpret_cast<const linux_dirent64 *>(buffer + offset);
+				listing.emplace(d->d_name, d->d_type);
+				offset += d->d_reclen;
+			}
+		::close(fd);
+		for (size_t i = first; i < last; i ++)
+		{
+			const auto item = listing.find(entries.at(i).name.toLocal8Bit().toStdString());
+			if (item == listing.end())
+				entries[i].status = MISSING;
+			else if (item->second == DT_DIR)
+				entries[i].status = NOT_A_FILE;
+		}
+#else
+		QDir directory(entries.at(first).directory);
+		if (!directory.exists())
+		{
+			for (size_t i = first; i < last; i ++)
+				entries[i].status = MISSING;
+			return;
+		}
+		for (const auto & name : directory.entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot))
+			listing.emplace(name.toStdString(), 0);
+		for (size_t i = first; i < last; i ++)
+			if (!listing.count(entries.at(i).name.toStdString()))
+				entries[i].status = MISSING;
+#endif
+	}
+	/* Checks the type and size of a file, which is present in the listing of its directory. */
+	void statFile(Entry & entry)
+	{
+		StageTimer statTimer(Metrics::STAT);
+		const QString path = entry.directory + '/' + entry.name;
+#ifdef Q_OS_LINUX
+		struct statx st;
+		/* Symbolic links are followed, as when reading the file. */
+		if (statx(AT_FDCWD, path.toLocal8Bit().constData(), AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_SIZE, & st))
+			entry.status = MISSING;
+		else if (!S_ISREG(st.stx_mode))
+			entry.status = NOT_A_FILE;
+		else
+		{
+			entry.status = REGULAR_FILE;
+			entry.size = st.stx_size;
+		}
+#else
+		QFileInfo fi(path);
+		entry.status = !fi.exists() ? MISSING : !fi.isFile() ? NOT_A_FILE : REGULAR_FILE;
+		entry.size = fi.size();
+#endif
+	}
+	/* Runs a function for all indices up to 'count' from 'thread_count' threads, taking 'batch_size' indices at a time. */
+	static void parallelFor(size_t count, size_t batch_size, unsigned thread_count, const std::function<void(size_t index)> & f)
+	{
+		std::atomic<size_t> next { 0 };
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < std::max(thread_count, 1u); t ++)
+			threads.emplace_back([&] (void) -> void {
+				size_t first;
+				while ((first = next.fetch_add(batch_size)) < count)
+					for (size_t i = first; i < std::min(first + batch_size, count); i ++)
+						f(i);
+			});
+		for (auto & t : threads)
+			t.join();
+	}
+public:
+	void add(const QString & path) { entries.push_back(entryFor(path)); }
+
+	/* Checks all files added, with 'thread_count' threads. */
+	void scan(unsigned thread_count)
+	{
+		std::sort(entries.begin(), entries.end(), less);
+		entries.erase(std::unique(entries.begin(), entries.end(), [] (const Entry & a, const Entry & b) -> bool
+			{ return a.directory == b.directory && a.name == b.name; }), entries.end());
+		directories.clear();
+		for (size_t i = 0; i < entries.size(); i ++)
+			if (!i || entries.at(i).directory != entries.at(i - 1).directory)
+				directories.push_back(i);
+		directories.push_back(entries.size());
+
+		/* First list all directories, and then check the remaining files, so that the files of a large directory
+		 * are also checked concurrently. */
+		parallelFor(directories.size() - 1, 1, thread_count, [&] (size_t i) -> void { listDirectory(directories.at(i), directories.at(i + 1)); });
+		parallelFor(entries.size(), STAT_BATCH_SIZE, thread_count, [&] (size_t i) -> void {
+			if (entries.at(i).status == PENDING)
+				statFile(entries[i]);
+		});
+	}
+
+	size_t fileCount(void) const { return entries.size(); }
+	size_t directoryCount(void) const { return directories.size() ? directories.size() - 1 : 0; }
+	/* Returns the entry of a file, or null if the file has not been scanned. */
+	const Entry * find(const QString & path) const
+	{
+		const Entry entry = entryFor(path);
+		auto e = std::lower_bound(entries.begin(), entries.end(), entry, less);
+		return e != entries.end() && e->directory == entry.directory && e->name == entry.name ? & * e : 0;
+	}
+};
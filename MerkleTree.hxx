@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCryptographicHash>
+
+#include <algorithm>
+#include <vector>
+
+/* The SHA-256 Merkle trees of BitTorrent v2 (BEP 52) torrents.
+ *
+ * Each file has a tree of its own. The leaves of the tree are the SHA-256 hashes of the 16 KiB blocks of the file
+ * (the last block may be shorter), and the number of leaves is padded to a power of two with zero hashes. The root
+ * of the tree is the 'pieces root' of the file. The layer of the tree, in which each node covers one piece, is the
+ * 'piece layer' of the file; it is stored in the torrent for each file, which is larger than one piece. */
+class MerkleTree
+{
+public:
+	enum
+	{
+		LEAF_SIZE	= 16 * 1024,
+		HASH_SIZE	= 32,
+	};
+
+	static QByteArray hash(QByteArrayView data) { return QCryptographicHash::hash(data, QCryptographicHash::Sha256); }
+	static QByteArray hashPair(const QByteArray & left, const QByteArray & right) { return hash(left + right); }
+
+	/* Returns the smallest power of two, which is not less than 'n'. */
+	static uint64_t powerOfTwo(uint64_t n)
+	{
+		uint64_t p = 1;
+		while (p < n)
+			p <<= 1;
+		return p;
+	}
+	/* Returns the root of a tree with 'leaf_count' leaves, all of which are zero hashes. */
+	static QByteArray zeroRoot(uint64_t leaf_count)
+	{
+		QByteArray h(HASH_SIZE, 0);
+		for (; leaf_count > 1; leaf_count >>= 1)
+			h = hashPair(h, h);
+		return h;
+	}
+	/* Returns the root of a tree, with the specified nodes at its base, padded with 'padding' nodes
+	 * to 'width' nodes (a power of two). */
+	static QByteArray root(std::vector<QByteArray> layer, uint64_t width, QByteArray padding)
+	{
+		if (!layer.size())
+			return padding;
+		for (; width > 1; width >>= 1)
+		{
+			std::vector<QByteArray> next;
+			for (size_t i = 0; i < layer.size(); i += 2)
+				next.push_back(hashPair(layer.at(i), i + 1 < layer.size() ? layer.at(i + 1) : padding));
+			layer.swap(next);
+			padding = hashPair(padding, padding);
+		}
+		return layer.at(0);
+	}
+	/* Returns the root of the subtree over a piece of data, which consists of 'width' blocks (a power of two). */
+	static QByteArray pieceRoot(QByteArrayView data, uint64_t width)
+	{
+		std::vector<QByteArray> leaves;
+		for (qsizetype offset = 0; offset < data.size(); offset += LEAF_SIZE)
+			leaves.push_back(hash(data.mid(offset, std::min((qsizetype) LEAF_SIZE, data.size() - offset))));
+		return root(leaves, width, QByteArray(HASH_SIZE, 0));
+	}
+};
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QSaveFile>
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BitTorrent.hxx"
+#include "VerificationCache.hxx"
+
+/* A compact, binary catalog of the parsed metadata of a set of torrents, so that torrents which are verified
+ * again and again do not have to be read and parsed again on each run.
+ *
+ * The catalog file is memory-mapped and used in place. It consists of fixed-size records - one per torrent and one per
+ * data file - followed by the path components of the files, as indices into a table of interned strings, and by the raw
+ * SHA1 piece digests of all torrents, which are referred to directly by the torrents loaded from the catalog.
+ * The torrent records are sorted by the hash of the torrent file name, and a table of the hashes of the paths of all data
+ * files, relative to the torrent data directory, is used to find which torrent a data file belongs to.
+ *
+ * Each torrent record holds the stamp of the torrent file at the time the catalog was built, and torrent files which
+ * have changed since are parsed again. Like the verification cache, the file is written in host byte order.
+ * v2 torrents are not cataloged - they are always parsed from the torrent file. */
+class MetadataCatalog : public std::enable_shared_from_this<MetadataCatalog>
+{
+public:
+	enum
+	{
+		VERSION		= 1,
+		NO_STRING	= 0xffffffff,
+		/* The file record flag for padding files. */
+		PADDING_FILE	= 1 << 0,
+	};
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t torrent_count;
+		uint32_t file_count;
+		uint32_t component_count;
+		uint32_t owner_count;
+		uint32_t string_count;
+		uint64_t torrents_offset;
+		uint64_t files_offset;
+		uint64_t components_offset;
+		uint64_t owners_offset;
+		/* 'string_count' + 1 offsets, relative to the start of the strings. */
+		uint64_t string_offsets_offset;
+		uint64_t strings_offset;
+		uint64_t digests_offset;
+		uint64_t digests_size;
+		/* The size of the catalog file. */
+		uint64_t size;
+	};
+	struct TorrentRecord
+	{
+		/* The hash of the torrent file name, as specified in the torrent list. */
+		uint64_t source_hash;
+		/* The stamp of the torrent file when it was cataloged. */
+		VerificationCache::FileStamp source_stamp;
+		int64_t piece_length;
+		/* The length of a single-file torrent, -1 for multi-file torrents. */
+		int64_t length;
+		/* The offset of the piece digests of the torrent, relative to the start of the digests. */
+		uint64_t digests;
+		uint64_t piece_count;
+		uint32_t source;
+		uint32_t name;
+		uint32_t md5sum;
+		uint32_t first_file;
+		uint32_t file_count;
+		char info_hash[BitTorrent::SHA1_CHECKSUM_BYTESIZE];
+	};
+	struct FileRecord
+	{
+		int64_t length;
+		uint32_t first_component;
+		uint32_t component_count;
+		uint32_t md5sum;
+		uint32_t flags;
+	};
+	struct OwnerRecord
+	{
+		/* The hash of the path of a data file, relative to the torrent data directory. */
+		uint64_t path_hash;
+		uint32_t torrent;
+		/* The index of the file in the torrent, 0 for single-file torrents. */
+		uint32_t file;
+	};
+
+	/* 64-bit FNV-1a. */
+	static uint64_t hash(const QString & s)
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (const char c : s.toUtf8())
+			h = (h ^ (uint8_t) c) * 0x100000001b3ull;
+		return h;
+	}
+
+	/* Collects the metadata of parsed torrents, and writes the catalog file. */
+	class Builder
+	{
+	private:
+		std::vector<TorrentRecord> torrents;
+		std::vector<FileRecord> files;
+		std::vector<uint32_t> components;
+		std::vector<OwnerRecord> owners;
+		std::vector<QByteArray> strings;
+		std::unordered_map<std::string, uint32_t> stringIds;
+		QByteArray digests;
+
+		uint32_t intern(const QString & s)
+		{
+			if (s.isEmpty())
+				return NO_STRING;
+			const QByteArray utf8 = s.toUtf8();
+			const auto id = stringIds.emplace(utf8.toStdString(), strings.size());
+			if (id.second)
+				strings.push_back(utf8);
+			return id.first->second;
+		}
+		/* Appends a section, and returns its offset. All sections are 8-byte aligned. */
+		static uint64_t append(QByteArray & data, const char * section, size_t size)
+		{
+			data.append(QByteArray((8 - data.size() % 8) % 8, 0));
+			const uint64_t offset = data.size();
+			data.append(section, size);
+			return offset;
+		}
+		template <typename T> static uint64_t append(QByteArray & data, const std::vector<T> & records)
+		{
+			return append(data, reinterpret_cast<const char *>(records.data()), records.size() * sizeof(T));
+		}
+	public:
+		/* Adds a parsed torrent. Returns false for torrents which are not cataloged. */
+		bool add(const QString & torrentFileName, const BitTorrent & bitTorrent)
+		{
+			const BitTorrent::TorrentDetails & d = bitTorrent.torrent_details;
+			if (bitTorrent.hasV2Hashes())
+				return false;
+			TorrentRecord r {};
+			r.source_hash = hash(torrentFileName);
+			r.source_stamp = VerificationCache::FileStamp::of(torrentFileName);
+			r.piece_length = d.piece_length;
+			r.length = d.files.length() ? -1 : d.length;
+			r.digests = digests.size();
+			r.piece_count = bitTorrent.pieceCount();
+			r.source = intern(torrentFileName);
+			r.name = intern(d.name);
+			r.md5sum = intern(d.md5sum);
+			r.first_file = files.size();
+			r.file_count = d.files.length();
+			memcpy(r.info_hash, d.info_hash.constData(), std::min(sizeof r.info_hash, (size_t) d.info_hash.size()));
+			digests.append(d.piece_sha1_hashes);
+
+			if (!d.files.length())
+				owners.push_back(OwnerRecord { hash(d.name), (uint32_t) torrents.size(), 0 });
+			for (const auto & f : d.files)
+			{
+				FileRecord fr { f.length, (uint32_t) components.size(), (uint32_t) f.path.length(), intern(f.md5sum), f.padding ? (uint32_t) PADDING_FILE : 0 };
+				for (const auto & p : f.path)
+					components.push_back(intern(p));
+				if (!f.padding)
+					owners.push_back(OwnerRecord { hash(d.name + '/' + f.path.join('/')), (uint32_t) torrents.size(), (uint32_t) (files.size() - r.first_file) });
+				files.push_back(fr);
+			}
+			torrents.push_back(r);
+			return true;
+		}
+		int count(void) const { return torrents.size(); }
+
+		bool write(const QString & fileName)
+		{
+			/* Sort the torrents by the hash of the torrent file name, and the data files by the hash of their path. */
+			std::vector<uint32_t> order(torrents.size()), position(torrents.size());
+			for (size_t i = 0; i < order.size(); i ++)
+				order[i] = i;
+			std::stable_sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) -> bool { return torrents.at(a).source_hash < torrents.at(b).source_hash; });
+			std::vector<TorrentRecord> sortedTorrents;
+			for (size_t i = 0; i < order.size(); i ++)
+			{
+				sortedTorrents.push_back(torrents.at(order.at(i)));
+				position[order.at(i)] = i;
+			}
+			for (auto & o : owners)
+				o.torrent = position.at(o.torrent);
+			std::sort(owners.begin(), owners.end(), [] (const OwnerRecord & a, const OwnerRecord & b) -> bool
+				{ return a.path_hash < b.path_hash || (a.path_hash == b.path_hash && (a.torrent < b.torrent || (a.torrent == b.torrent && a.file < b.file))); });
+			std::vector<uint64_t> stringOffsets(1, 0);
+			QByteArray stringData;
+			for (const auto & s : strings)
+			{
+				stringData.append(s);
+				stringOffsets.push_back(stringData.size());
+			}
+
+			Header header;
+			memset(& header, 0, sizeof header);
+			memcpy(header.magic, MAGIC, sizeof header.magic);
+			header.version = VERSION;
+			header.torrent_count = sortedTorrents.size();
+			header.file_count = files.size();
+			header.component_count = components.size();
+			header.owner_count = owners.size();
+			header.string_count = strings.size();
+			QByteArray data(sizeof header, 0);
+			header.torrents_offset = append(data, sortedTorrents);
+			header.files_offset = append(data, files);
+			header.components_offset = append(data, components);
+			header.owners_offset = append(data, owners);
+			header.string_offsets_offset = append(data, stringOffsets);
+			header.strings_offset = append(data, stringData.constData(), stringData.size());
+			header.digests_offset = append(data, digests.constData(), digests.size());
+			header.digests_size = digests.size();
+			header.size = data.size();
+			memcpy(data.data(), & header, sizeof header);
+
+			QSaveFile f(fileName);
+			if (!f.open(QFile::WriteOnly) || f.write(data) != data.size() || !f.commit())
+			{
+				qCritical() << "Can not write the metadata catalog file:" << fileName;
+				return false;
+			}
+			return true;
+		}
+	};
+
+private:
+	static constexpr char MAGIC[8] = { 'T', 'F', 'P', 'C', 'A', 'T', 'L', 'G' };
+	QFile file;
+	const uchar * mapping = 0;
+	const Header * header = 0;
+	const TorrentRecord * torrents = 0;
+	const FileRecord * files = 0;
+	const uint32_t * components = 0;
+	const OwnerRecord * owners = 0;
+	const uint64_t * stringOffsets = 0;
+	const char * strings = 0;
+	const char * digests = 0;
+
+	/* Checks that all records refer to data within the catalog, so that the records can be used without further checks. */
+	bool validate(void) const
+	{
+		for (uint32_t i = 0; i < header->string_count; i ++)
+			if (stringOffsets[i] > stringOffsets[i + 1])
+				return false;
+		if (stringOffsets[0] || stringOffsets[header->string_count] > header->digests_offset - header->strings_offset)
+			return false;
+		std::function<bool(uint32_t id)> validString = [&] (uint32_t id) -> bool { return id == NO_STRING || id < header->string_count; };
+		for (uint32_t i = 0; i < header->component_count; i ++)
+			if (!validString(components[i]))
+				return false;
+		for (uint32_t i = 0; i < header->file_count; i ++)
+			if ((uint64_t) files[i].first_component + files[i].component_count > header->component_count || !validString(files[i].md5sum))
+				return false;
+		for (uint32_t i = 0; i < header->torrent_count; i ++)
+		{
+			const TorrentRecord & t = torrents[i];
+			if (t.source >= header->string_count || !validString(t.name) || !validString(t.md5sum)
+					|| (uint64_t) t.first_file + t.file_count > header->file_count
+					|| t.piece_count > header->digests_size / BitTorrent::SHA1_CHECKSUM_BYTESIZE
+					|| t.digests > header->digests_size - t.piece_count * BitTorrent::SHA1_CHECKSUM_BYTESIZE)
+				return false;
+		}
+		for (uint32_t i = 0; i < header->owner_count; i ++)
+			if (owners[i].torrent >= header->torrent_count
+					|| owners[i].file >= std::max(torrents[owners[i].torrent].file_count, 1u))
+				return false;
+		return true;
+	}
+	QString string(uint32_t id) const
+	{
+		if (id == NO_STRING)
+			return QString();
+		return QString::fromUtf8(strings + stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]);
+	}
+	/* Returns the path of a data file, relative to the torrent data directory. */
+	QString dataFilePath(const TorrentRecord & t, uint32_t file_index) const
+	{
+		QString path = string(t.name);
+		if (t.file_count)
+		{
+			const FileRecord & f = files[t.first_file + file_index];
+			for (uint32_t i = 0; i < f.component_count; i ++)
+				path += '/' + string(components[f.first_component + i]);
+		}
+		return path;
+	}
+public:
+	MetadataCatalog(const QString & fileName) : file(fileName) {}
+	~MetadataCatalog()
+	{
+		if (mapping)
+			file.unmap(const_cast<uchar *>(mapping));
+	}
+
+	/* Maps the catalog file, and checks it. */
+	bool open(void)
+	{
+		if (!file.open(QFile::ReadOnly))
+		{
+			qCritical() << "Can not open the metadata catalog file:" << file.fileName();
+			return false;
+		}
+		const uint64_t size = file.size();
+		if (size < sizeof(Header) || !(mapping = file.map(0, size)))
+		{
+			qCritical() << "Can not map the metadata catalog file:" << file.fileName();
+			return false;
+		}
+		header = reinterpret_cast<const Header *>(mapping);
+		std::function<bool(uint64_t offset, uint64_t count, uint64_t record_size)> inFile = [&] (uint64_t offset, uint64_t count, uint64_t record_size) -> bool {
+			return !(offset % 8) && offset <= size && count <= (size - offset) / record_size;
+		};
+		if (memcmp(header->magic, MAGIC, sizeof MAGIC) || header->version != VERSION || header->size != size
+				|| !inFile(header->torrents_offset, header->torrent_count, sizeof(TorrentRecord))
+				|| !inFile(header->files_offset, header->file_count, sizeof(FileRecord))
+				|| !inFile(header->components_offset, header->component_count, sizeof(uint32_t))
+				|| !inFile(header->owners_offset, header->owner_count, sizeof(OwnerRecord))
+				|| !inFile(header->string_offsets_offset, header->string_count + 1ull, sizeof(uint64_t))
+				|| header->strings_offset > header->digests_offset || !inFile(header->digests_offset, header->digests_size, 1))
+		{
+			qCritical() << "Invalid metadata catalog file:" << file.fileName();
+			return false;
+		}
+		torrents = reinterpret_cast<const TorrentRecord *>(mapping + header->torrents_offset);
+		files = reinterpret_cast<const FileRecord *>(mapping + header->files_offset);
+		components = reinterpret_cast<const uint32_t *>(mapping + header->components_offset);
+		owners = reinterpret_cast<const OwnerRecord *>(mapping + header->owners_offset);
+		stringOffsets = reinterpret_cast<const uint64_t *>(mapping + header->string_offsets_offset);
+		strings = reinterpret_cast<const char *>(mapping + header->strings_offset);
+		digests = reinterpret_cast<const char *>(mapping + header->digests_offset);
+		if (!validate())
+		{
+			qCritical() << "Invalid metadata catalog file:" << file.fileName();
+			return false;
+		}
+		return true;
+	}
+
+	int count(void) const { return header->torrent_count; }
+	QString torrentFileName(int record) const { return string(torrents[record].source); }
+
+	/* Returns the record of a torrent file, or -1 if the torrent file is not in the catalog. */
+	int find(const QString & torrentFileName) const
+	{
+		const uint64_t h = hash(torrentFileName);
+		const TorrentRecord * end = torrents + header->torrent_count;
+		for (const TorrentRecord * t = std::lower_bound(torrents, end, h, [] (const TorrentRecord & t, uint64_t h) -> bool { return t.source_hash < h; });
+				t != end && t->source_hash == h; t ++)
+			if (string(t->source) == torrentFileName)
+				return t - torrents;
+		return -1;
+	}
+	/* Returns true if the torrent file has not changed since it was cataloged. */
+	bool isCurrent(int record) const
+	{
+		return VerificationCache::FileStamp::of(string(torrents[record].source)) == torrents[record].source_stamp;
+	}
+	/* Returns a torrent loaded from the catalog. The piece digests of the torrent refer directly to the mapped catalog,
+	 * which is kept mapped for as long as the torrent exists. */
+	std::shared_ptr<BitTorrent> torrent(int record) const
+	{
+		const TorrentRecord & t = torrents[record];
+		auto bitTorrent = std::make_shared<BitTorrent>(string(t.source));
+		BitTorrent::TorrentDetails & d = bitTorrent->torrent_details;
+		d.name = string(t.name);
+		d.piece_length = t.piece_length;
+		d.length = t.length;
+		d.md5sum = string(t.md5sum);
+		d.piece_sha1_hashes = QByteArray::fromRawData(digests + t.digests, t.piece_count * BitTorrent::SHA1_CHECKSUM_BYTESIZE);
+		d.info_hash = QByteArray(t.info_hash, sizeof t.info_hash);
+		for (uint32_t i = 0; i < t.file_count; i ++)
+		{
+			const FileRecord & f = files[t.first_file + i];
+			QStringList path;
+			for (uint32_t c = 0; c < f.component_count; c ++)
+				path << string(components[f.first_component + c]);
+			d.files << BitTorrent::TorrentDetails::file_info(path, f.length, string(f.md5sum));
+			d.files.last().padding = f.flags & PADDING_FILE;
+		}
+		bitTorrent->metadata_storage = shared_from_this();
+		return bitTorrent;
+	}
+	/* Finds the torrent which holds a data file, specified relative to the torrent data directory.
+	 * Returns the torrent record, and the index of the file in the torrent; or -1, if no torrent holds the file. */
+	int owner(const QString & dataFilePath, int & file_index) const
+	{
+		const uint64_t h = hash(dataFilePath);
+		const OwnerRecord * end = owners + header->owner_count;
+		for (const OwnerRecord * o = std::lower_bound(owners, end, h, [] (const OwnerRecord & o, uint64_t h) -> bool { return o.path_hash < h; });
+				o != end && o->path_hash == h; o ++)
+			if (this->dataFilePath(torrents[o->torrent], o->file) == dataFilePath)
+			{
+				file_index = o->file;
+				return o->torrent;
+			}
+		return -1;
+	}
+};
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QSaveFile>
+#include <QDebug>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/sysmacros.h>
+#endif
+
+/* A histogram with power-of-two buckets, which can be updated concurrently from any thread, without locking.
+ * Values are recorded as unsigned integers (e.g. nanoseconds), and scaled when exported (e.g. to seconds). */
+class Histogram
+{
+public:
+	enum
+	{
+		/* Bucket 'i' counts the values less than or equal to 2^(i + first_exponent), the last bucket counts all other values. */
+		BUCKET_COUNT	= 28,
+	};
+private:
+	const unsigned first_exponent;
+	std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+	std::atomic<uint64_t> count { 0 }, sum { 0 };
+public:
+	Histogram(unsigned first_exponent) : first_exponent(first_exponent) {}
+
+	void record(uint64_t value)
+	{
+		unsigned i = 0;
+		while (i < BUCKET_COUNT - 1 && value > (uint64_t) 1 << (i + first_exponent))
+			i ++;
+		buckets[i].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+	}
+	/* Appends the histogram in Prometheus text format. The labels, if any, are of the form 'name="value"'. */
+	void format(QByteArray & text, const char * name, const QString & labels, double scale) const
+	{
+		const QString prefix = labels.isEmpty() ? QString() : labels + ',';
+		uint64_t cumulative = 0;
+		for (unsigned i = 0; i < BUCKET_COUNT - 1; i ++)
+		{
+			cumulative += buckets[i].load(std::memory_order_relaxed);
+			text += QString("%1_bucket{%2le=\"%3\"} %4\n").arg(name).arg(prefix)
+				.arg((double) ((uint64_t) 1 << (i + first_exponent)) * scale).arg(cumulative).toUtf8();
+		}
+		cumulative += buckets[BUCKET_COUNT - 1].load(std::memory_order_relaxed);
+		text += QString("%1_bucket{%2le=\"+Inf\"} %3\n").arg(name).arg(prefix).arg(cumulative).toUtf8();
+		const QString braces = labels.isEmpty() ? QString() : '{' + labels + '}';
+		text += QString("%1_sum%2 %3\n").arg(name).arg(braces).arg((double) sum.load(std::memory_order_relaxed) * scale).toUtf8();
+		text += QString("%1_count%2 %3\n").arg(name).arg(braces).arg(count.load(std::memory_order_relaxed)).toUtf8();
+	}
+};
+
+/* The process-wide performance metrics of the verification hot path.
+ *
+ * The durations of the verification stages are recorded in nanoseconds, and are exported in seconds:
+ *	stat		- checking that a data file exists, and has the expected size
+ *	open		- opening (and memory-mapping) a data file
+ *	read		- a single read request, from its submission to the read engine until its completion
+ *	io_wait		- the time that the data reading thread waits for a batch of reads to complete
+ *	hash		- hashing a piece, or a batch of pieces with a multi-buffer SHA1 kernel
+ *	queue_wait	- the time that the data reading thread waits for room in the hashing queue
+ *	md5		- adding a segment of a data file to the MD5 hash of the file, in the MD5 worker thread
+ *
+ * Comparing the totals tells where a slow run spends its time: mostly in 'io_wait' means the run is disk-bound,
+ * mostly in 'queue_wait' (or in 'hash', without hashing threads) means the run is CPU-bound. */
+class Metrics
+{
+public:
+	enum Stage
+	{
+		STAT,
+		OPEN,
+		READ,
+		IO_WAIT,
+		HASH,
+		QUEUE_WAIT,
+		MD5,
+		STAGE_COUNT,
+	};
+	/* The number of pieces waiting in the hashing queue, sampled whenever a piece is queued. */
+	Histogram queue_depth { 0 };
+	std::atomic<uint64_t> pieces_hashed { 0 }, pieces_corrupted { 0 };
+	std::atomic<uint64_t> torrents_verified { 0 }, torrents_failed { 0 };
+	/* The time that reads have waited to be issued, see 'ReadThrottle', and the adaptive limit of reads in flight (0 - none). */
+	std::atomic<uint64_t> read_throttled_ns { 0 }, read_concurrency_limit { 0 };
+private:
+	/* Bucket bounds from 1 microsecond up. */
+	Histogram stages[STAGE_COUNT] { 10, 10, 10, 10, 10, 10, 10 };
+	std::mutex mutex;
+	/* The number of bytes read (or mapped) for hashing, for each storage device holding torrent data. */
+	std::map<uint64_t, std::atomic<uint64_t>> device_bytes;
+
+	Metrics(void) {}
+public:
+	static Metrics & instance(void)
+	{
+		static Metrics metrics;
+		return metrics;
+	}
+	static uint64_t now(void)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	static const char * stageName(Stage stage)
+	{
+		static const char * names[STAGE_COUNT] = { "stat", "open", "read", "io_wait", "hash", "queue_wait", "md5" };
+		return names[stage];
+	}
+
+	void record(Stage stage, uint64_t nanoseconds) { stages[stage].record(nanoseconds); }
+	/* The counter of bytes read for a storage device (see 'TorrentScheduler::deviceId()'), which stays valid
+	 * for the lifetime of the process, so that the hot path can update it without locking. */
+	std::atomic<uint64_t> & deviceBytes(uint64_t device)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return device_bytes[device];
+	}
+
+	/* Returns all metrics in the Prometheus text exposition format. */
+	QByteArray prometheusText(void)
+	{
+		QByteArray text;
+		text += "# HELP tfp_stage_duration_seconds The duration of the torrent data verification stages.\n";
+		text += "# TYPE tfp_stage_duration_seconds histogram\n";
+		for (int i = 0; i < STAGE_COUNT; i ++)
+			stages[i].format(text, "tfp_stage_duration_seconds", QString("stage=\"%1\"").arg(stageName((Stage) i)), 1e-9);
+		text += "# HELP tfp_hash_queue_depth The number of pieces waiting to be hashed, when a piece is queued.\n";
+		text += "# TYPE tfp_hash_queue_depth histogram\n";
+		queue_depth.format(text, "tfp_hash_queue_depth", QString(), 1);
+
+		std::function<void(const char * name, const char * help, uint64_t value)> counter =
+				[&] (const char * name, const char * help, uint64_t value) -> void {
+			text += QString("# HELP %1 %2\n# TYPE %1 counter\n%1 %3\n").arg(name).arg(help).arg(value).toUtf8();
+		};
+		counter("tfp_pieces_hashed_total", "The number of torrent pieces hashed.", pieces_hashed);
+		counter("tfp_pieces_corrupted_total", "The number of torrent pieces with a SHA1 or SHA-256 hash mismatch.", pieces_corrupted);
+		counter("tfp_torrents_verified_total", "The number of torrents verified.", torrents_verified);
+		counter("tfp_torrents_failed_total", "The number of torrents, which failed verification.", torrents_failed);
+		text += "# HELP tfp_read_throttled_seconds_total The time that data reads have waited to be issued, because of the read rate limit or the adaptive concurrency limit.\n";
+		text += "# TYPE tfp_read_throttled_seconds_total counter\n";
+		text += QString("tfp_read_throttled_seconds_total %1\n").arg(read_throttled_ns.load() / 1e9).toUtf8();
+		text += "# HELP tfp_read_concurrency_limit The adaptive limit of data reads in flight, 0 if not adaptive.\n";
+		text += "# TYPE tfp_read_concurrency_limit gauge\n";
+		text += QString("tfp_read_concurrency_limit %1\n").arg(read_concurrency_limit.load()).toUtf8();
+
+		text += "# HELP tfp_read_bytes_total The number of bytes of torrent data read, by storage device.\n";
+		text += "# TYPE tfp_read_bytes_total counter\n";
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto & d : device_bytes)
+		{
+#ifdef Q_OS_LINUX
+			const QString device = QString("%1:%2").arg(major(d.first)).arg(minor(d.first));
+#else
+			const QString device = QString::number(d.first);
+#endif
+			text += QString("tfp_read_bytes_total{device=\"%1\"} %2\n").arg(device).arg(d.second.load()).toUtf8();
+		}
+		return text;
+	}
+};
+
+/* Records the duration of a stage, from construction to destruction. */
+class StageTimer
+{
+private:
+	const Metrics::Stage stage;
+	const uint64_t start = Metrics::now();
+public:
+	StageTimer(Metrics::Stage stage) : stage(stage) {}
+	~StageTimer() { Metrics::instance().record(stage, Metrics::now() - start); }
+};
+
+/* Periodically writes the metrics in Prometheus text format, either to a file, or to a local Unix domain socket.
+ *
+ * A file is replaced atomically with each dump, so it can be picked up at any time, e.g. by the node exporter textfile
+ * collector. For a socket target, specified as 'unix:<path>', each dump is sent over a new connection to a listening
+ * stream socket, e.g. of a local metrics agent. A final dump is written when the exporter is destroyed. */
+class MetricsExporter
+{
+private:
+	const QString target;
+	const unsigned interval_seconds;
+	std::mutex mutex;
+	std::condition_variable stop_requested;
+	bool stop = false;
+	std::thread thread;
+
+	bool dump(void)
+	{
+		const QByteArray text = Metrics::instance().prometheusText();
+		if (!target.startsWith("unix:"))
+		{
+			QSaveFile f(target);
+			return f.open(QFile::WriteOnly) && f.write(text) == text.size() && f.commit();
+		}
+#ifdef Q_OS_UNIX
+		struct sockaddr_un address = {};
+		const QByteArray path = target.mid(5).toLocal8Bit();
+		if ((size_t) path.size() >= sizeof address.sun_path)
+			return false;
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, path.constData(), path.size());
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s < 0)
+			return false;
+		/* Do not raise SIGPIPE, if the listener closes the connection early. Where sends can not be flagged
+		 * with MSG_NOSIGNAL (macOS, some BSDs), the socket option does the same. */
+#ifdef MSG_NOSIGNAL
+		const int flags = MSG_NOSIGNAL;
+#else
+		const int flags = 0, one = 1;
+		setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, & one, sizeof one);
+#endif
+		bool ok = !::connect(s, (struct sockaddr *) & address, sizeof address);
+		for (qsizetype x = 0, written; ok && x < text.size(); x += written)
+			ok = (written = ::send(s, text.constData() + x, text.size() - x, flags)) > 0;
+		::close(s);
+		return ok;
+#else
+		return false;
+#endif
+	}
+	void exporter(void)
+	{
+		bool reported_failure = false;
+		std::unique_lock<std::mutex> lock(mutex);
+		do
+		{
+			stop_requested.wait_for(lock, std::chrono::seconds(interval_seconds), [&] { return stop; });
+			/* Only report the first failure, the target may become available later. */
+			if (!dump() && !reported_failure)
+			{
+				qCritical() << "Can not write the metrics to:" << target;
+				reported_failure = true;
+			}
+		}
+		while (!stop);
+	}
+public:
+	MetricsExporter(const QString & target, unsigned interval_seconds)
+		: target(target), interval_seconds(std::max(interval_seconds, 1u)), thread(& MetricsExporter::exporter, this) {}
+	~MetricsExporter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+			stop_requested.notify_all();
+		}
+		thread.join();
+	}
+};
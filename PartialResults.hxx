@@ -0,0 +1,150 @@
+#pragma once
+
+#include <QFile>
+#include <QStringList>
+#include <QDebug>
+
+#include <map>
+#include <set>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "ShardCoordinator.hxx"
+#include "TorrentVerifier.hxx"
+
+/* The results of the shards verified by a worker process (see 'ShardCoordinator'). The partial result files of all
+ * workers are merged into the results of the whole run.
+ *
+ * Like the checkpoint journal, a partial result file is a text file, which is only ever appended to, one tab-separated
+ * record per line:
+ *
+ *	data-directory	<directory>
+ *	failure		<torrent index>	<first piece>	sha1|sha256|md5	<file name>	- a corrupted file has been found in a shard
+ *	shard		<torrent index>	<first piece>	<last piece>	<shard count>	ok|error	<hashed length>	<elapsed ms>	<torrent file name>
+ *										- a shard has been verified
+ *
+ * The failures of a shard are written ahead of the shard record, and only count once the shard record has been read,
+ * so that a shard, which was being recorded when the worker was interrupted, is not taken into account. A shard, which
+ * is recorded more than once (e.g. by a worker, which has been presumed lost), is only taken into account once. */
+class PartialResults
+{
+public:
+	struct TorrentResults
+	{
+		QString torrent_file;
+		int shard_count = 0;
+		/* The first pieces of the shards recorded. */
+		std::set<int64_t> shards;
+		bool ok = true;
+		QStringList sha1_failures, sha256_failures, md5_failures;
+		uint64_t hashed_length = 0;
+		uint64_t elapsed_ms = 0;
+		bool complete(void) const { return shard_count && (int) shards.size() == shard_count; }
+	};
+private:
+	QFile file;
+	std::map<int, TorrentResults> torrents;
+
+	void append(const QStringList & fields)
+	{
+		file.write((fields.join('\t') + '\n').toUtf8());
+	}
+public:
+	/* Opens a partial result file for appending. */
+	bool open(const QString & fileName, const QString & data_directory)
+	{
+		file.setFileName(fileName);
+		if (!file.open(QFile::WriteOnly | QFile::Append))
+		{
+			qCritical() << "Can not open partial result file for writing:" << fileName;
+			return false;
+		}
+		/* Terminate an incomplete last line, which is ignored when loading the file. */
+		QFile existing(fileName);
+		if (existing.open(QFile::ReadOnly) && existing.size() && existing.seek(existing.size() - 1) && existing.read(1) != "\n")
+			file.write("\n");
+		append(QStringList() << "data-directory" << data_directory);
+		return file.flush();
+	}
+	const QString fileName(void) const { return file.fileName(); }
+
+	/* Records the results of a shard, and flushes them to disk. */
+	bool record(const ShardCoordinator::Shard & shard, const TorrentCheckResult & checkResult, bool ok)
+	{
+		const QString index = QString::number(shard.torrent_index), first_piece = QString::number(shard.first_piece);
+		for (const auto & f : checkResult.corrupted_files_by_sha1_checksum)
+			append(QStringList() << "failure" << index << first_piece << "sha1" << f);
+		for (const auto & f : checkResult.corrupted_files_by_sha256_checksum)
+			append(QStringList() << "failure" << index << first_piece << "sha256" << f);
+		for (const auto & f : checkResult.corrupted_files_by_md5_checksum)
+			append(QStringList() << "failure" << index << first_piece << "md5" << f);
+		append(QStringList() << "shard" << index << first_piece << QString::number(shard.last_piece) << QString::number(shard.shard_count)
+		       << (ok ? "ok" : "error") << QString::number(checkResult.hashed_length) << QString::number(checkResult.elapsed_ms) << checkResult.torrent_filename);
+		if (!file.flush())
+			return false;
+#ifdef Q_OS_UNIX
+		fdatasync(file.handle());
+#endif
+		return true;
+	}
+
+	/* Reads a partial result file, and merges its results with the results read so far. */
+	bool load(const QString & fileName, const QString & data_directory)
+	{
+		QFile f(fileName);
+		if (!f.open(QFile::ReadOnly))
+		{
+			qCritical() << "Can not open partial result file for reading:" << fileName;
+			return false;
+		}
+		const QByteArray data = f.readAll();
+		/* Ignore an incomplete last line. */
+		const QStringList lines = QString::fromUtf8(data.left(data.lastIndexOf('\n') + 1)).split('\n');
+		/* The failures of the shards, which have not been recorded yet, by torrent index and first piece. */
+		std::map<std::pair<int, int64_t>, std::map<QString, QStringList>> failures;
+		for (const auto & line : lines)
+		{
+			const QStringList fields = line.split('\t');
+			if (fields.at(0) == "data-directory" && fields.length() == 2)
+			{
+				if (fields.at(1) == data_directory)
+					continue;
+				qCritical() << "The partial result file is for a different torrent data directory:" << fileName;
+				return false;
+			}
+			bool ok = fields.length() >= 3;
+			const int index = ok ? fields.at(1).toInt(& ok) : -1;
+			const int64_t first_piece = ok ? fields.at(2).toLongLong(& ok) : -1;
+			if (!ok)
+				continue;
+			std::map<QString, QStringList> & shardFailures = failures[std::make_pair(index, first_piece)];
+			if (fields.at(0) == "failure" && fields.length() == 5)
+				shardFailures[fields.at(3)] << fields.at(4);
+			else if (fields.at(0) == "shard" && fields.length() == 9)
+			{
+				TorrentResults & t = torrents[index];
+				t.torrent_file = fields.at(8);
+				t.shard_count = fields.at(4).toInt();
+				if (t.shards.insert(first_piece).second)
+				{
+					t.ok &= fields.at(5) == "ok";
+					for (const auto & kind : shardFailures)
+					{
+						QStringList & failures = kind.first == "md5" ? t.md5_failures : kind.first == "sha256" ? t.sha256_failures : t.sha1_failures;
+						for (const auto & file : kind.second)
+							if (!failures.contains(file))
+								failures << file;
+					}
+					t.hashed_length += fields.at(6).toULongLong();
+					t.elapsed_ms += fields.at(7).toULongLong();
+				}
+				failures.erase(std::make_pair(index, first_piece));
+			}
+		}
+		return true;
+	}
+	/* The merged results, by torrent index. */
+	const std::map<int, TorrentResults> & results(void) const { return torrents; }
+};
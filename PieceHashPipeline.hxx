@@ -0,0 +1,291 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCryptographicHash>
+#include <QStringList>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "BitTorrent.hxx"
+#include "Metrics.hxx"
+#include "Sha1.hxx"
+
+/* A simple bounded, blocking multi-producer/multi-consumer queue.
+ * 'push()' blocks while the queue is full, 'pop()' blocks while the queue is empty.
+ * After 'close()' is called, 'pop()' drains the remaining items, and then returns false. */
+template <typename T> class BoundedQueue
+{
+private:
+	std::mutex mutex;
+	std::condition_variable not_empty, not_full;
+	std::deque<T> items;
+	const size_t capacity;
+	bool closed = false;
+public:
+	BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+	void push(T && item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [&] { return items.size() < capacity; });
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+	}
+	bool pop(T & item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [&] { return items.size() || closed; });
+		if (!items.size())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+	/* Blocks until at least one item is available, and then takes up to 'max_count' items without blocking further. */
+	bool pop(std::vector<T> & batch, size_t max_count)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [&] { return items.size() || closed; });
+		batch.clear();
+		while (items.size() && batch.size() < max_count)
+		{
+			batch.push_back(std::move(items.front()));
+			items.pop_front();
+		}
+		not_full.notify_all();
+		return batch.size();
+	}
+	void close(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+	size_t size(void) { std::lock_guard<std::mutex> lock(mutex); return items.size(); }
+};
+
+/* A completely assembled torrent piece, ready to be hashed.
+ * The piece data is not necessarily contiguous in memory - it is described by a list of segments,
+ * which are hashed one after another. The segments either point into a reused piece buffer,
+ * or directly into memory-mapped data files. */
+struct PieceJob
+{
+	int64_t		piece_index = -1;
+	std::vector<QByteArrayView> segments;
+	/* References to the piece buffer and/or the mapped files that the segments point into.
+	 * Releasing these makes the memory available for reuse. */
+	std::vector<std::shared_ptr<const void>> storage;
+	/* All files that contributed data to this piece, in torrent order. */
+	QStringList	files;
+
+	uint64_t length(void) const
+	{
+		uint64_t length = 0;
+		for (const auto & s : segments)
+			length += s.size();
+		return length;
+	}
+	QByteArray sha1(void) const { return Sha1::hash(segments); }
+};
+
+/* The outcome of hashing a single piece. Results are always reported together with the
+ * piece index, as the worker threads complete pieces out of order. */
+struct PieceResult
+{
+	int64_t		piece_index;
+	uint64_t	length;
+	bool		ok;
+	QStringList	files;
+};
+
+/* A pool of worker threads that compute the SHA1 hashes of torrent pieces, and compare them to the
+ * expected hashes from the torrent file. The data reading thread feeds completed pieces to the workers
+ * through a bounded queue, so that reading from disk and hashing overlap, while the memory used for
+ * the pieces in flight stays limited to a small multiple of the piece length. */
+class PieceHashPipeline
+{
+private:
+	const BitTorrent & torrent;
+	BoundedQueue<PieceJob> queue;
+	std::vector<std::thread> workers;
+	std::mutex results_mutex;
+	std::vector<PieceResult> results;
+
+	void worker(void)
+	{
+		/* With a multi-buffer SHA1 kernel, the workers take as many queued pieces as the kernel can hash at once. */
+		std::vector<PieceJob> jobs;
+		while (queue.pop(jobs, Sha1::isMultiBuffer() ? Sha1::MAX_LANES : 1))
+		{
+			std::vector<const Sha1::Segments *> messages;
+			for (const auto & job : jobs)
+				messages.push_back(& job.segments);
+			const uint64_t start = Metrics::now();
+			const std::vector<QByteArray> digests = Sha1::hashMultiBuffer(messages);
+			Metrics::instance().record(Metrics::HASH, Metrics::now() - start);
+			Metrics::instance().pieces_hashed += jobs.size();
+			std::vector<PieceResult> batch_results;
+			for (size_t i = 0; i < jobs.size(); i ++)
+			{
+				const PieceJob & job = jobs.at(i);
+				batch_results.push_back(PieceResult { job.piece_index, job.length(), torrent.pieceHashMatches(job.piece_index, digests.at(i)), job.files });
+			}
+			jobs.clear();
+			std::lock_guard<std::mutex> lock(results_mutex);
+			results.insert(results.end(), batch_results.begin(), batch_results.end());
+		}
+	}
+public:
+	PieceHashPipeline(const BitTorrent & torrent, unsigned thread_count)
+		: torrent(torrent), queue((Sha1::isMultiBuffer() ? Sha1::MAX_LANES : 2) * std::max(thread_count, 1u))
+	{
+		for (unsigned i = 0; i < std::max(thread_count, 1u); i ++)
+			workers.emplace_back(& PieceHashPipeline::worker, this);
+	}
+	~PieceHashPipeline() { finish(); }
+
+	void submit(PieceJob && job)
+	{
+		Metrics::instance().queue_depth.record(queue.size());
+		StageTimer timer(Metrics::QUEUE_WAIT);
+		queue.push(std::move(job));
+	}
+
+	/* Returns the results of the pieces hashed so far, which have not been returned before, sorted by piece index. */
+	std::vector<PieceResult> takeResults(void)
+	{
+		std::vector<PieceResult> completed;
+		{
+			std::lock_guard<std::mutex> lock(results_mutex);
+			completed.swap(results);
+		}
+		std::sort(completed.begin(), completed.end(), [] (const PieceResult & a, const PieceResult & b) -> bool
+			{ return a.piece_index < b.piece_index; });
+		return completed;
+	}
+
+	/* Waits for all submitted pieces to be hashed, and returns the remaining results, sorted by piece index. */
+	std::vector<PieceResult> finish(void)
+	{
+		queue.close();
+		for (auto & w : workers)
+			w.join();
+		workers.clear();
+		return takeResults();
+	}
+};
+
+/* Computes the MD5 hashes of whole data files in a worker thread of its own, from the same piece buffers (or memory-mapped
+ * files) that the pieces are SHA1-hashed from. MD5 checking thus neither reads the data a second time, nor adds to the
+ * work of the data reading thread, or of the SHA1 hashing threads. The data of each file must be added in file order,
+ * and the buffers that the data is in are held until the data has been hashed. */
+class FileMd5Worker
+{
+public:
+	enum
+	{
+		/* The maximum number of file segments waiting to be hashed. */
+		QUEUE_CAPACITY	= 8,
+	};
+	struct Result
+	{
+		int		file_index;
+		QByteArray	md5;
+	};
+private:
+	struct Job
+	{
+		int		file_index = -1;
+		QByteArrayView	data;
+		std::vector<std::shared_ptr<const void>> storage;
+		/* If set, all data of the file has been added, and the hash of the file is complete. */
+		bool		complete = false;
+	};
+	BoundedQueue<Job> queue { QUEUE_CAPACITY };
+	std::mutex mutex;
+	std::condition_variable idle;
+	/* The number of jobs submitted, and not yet completed. */
+	size_t pending = 0;
+	std::vector<Result> results;
+	std::thread thread;
+
+	void submit(Job && job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending ++;
+		}
+		queue.push(std::move(job));
+	}
+	void worker(void)
+	{
+		std::map<int, std::unique_ptr<QCryptographicHash>> hashes;
+		Job job;
+		while (queue.pop(job))
+		{
+			std::unique_ptr<QCryptographicHash> & md5 = hashes[job.file_index];
+			if (!md5)
+				md5 = std::make_unique<QCryptographicHash>(QCryptographicHash::Md5);
+			if (!job.complete)
+			{
+				StageTimer timer(Metrics::MD5);
+				md5->addData(job.data);
+			}
+			const Result result { job.file_index, job.complete ? md5->result() : QByteArray() };
+			if (job.complete)
+				hashes.erase(job.file_index);
+			const bool complete = job.complete;
+			/* Release the buffers right away. */
+			job = Job();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (complete)
+				results.push_back(result);
+			if (!-- pending)
+				idle.notify_all();
+		}
+	}
+public:
+	FileMd5Worker(void) : thread(& FileMd5Worker::worker, this) {}
+	~FileMd5Worker() { finish(); }
+
+	void add(int file_index, QByteArrayView data, const std::vector<std::shared_ptr<const void>> & storage)
+	{
+		submit(Job { file_index, data, storage, false });
+	}
+	/* Marks the end of the data of a file, its hash will be among the next results. */
+	void complete(int file_index) { submit(Job { file_index, QByteArrayView(), {}, true }); }
+
+	/* Returns the hashes of the files completed so far, which have not been returned before. */
+	std::vector<Result> takeResults(void)
+	{
+		std::vector<Result> completed;
+		std::lock_guard<std::mutex> lock(mutex);
+		completed.swap(results);
+		return completed;
+	}
+	/* Waits for all data added so far to be hashed, and returns the remaining results. */
+	std::vector<Result> wait(void)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [&] { return !pending; });
+		std::vector<Result> completed;
+		completed.swap(results);
+		return completed;
+	}
+	/* Stops the worker, once all data added has been hashed, and returns the remaining results. */
+	std::vector<Result> finish(void)
+	{
+		queue.close();
+		if (thread.joinable())
+			thread.join();
+		return takeResults();
+	}
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QFile>
+#include <QStringList>
+
+#include <condition_variable>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+enum
+{
+	/* The alignment of the piece buffers, and the alignment required for direct (O_DIRECT) reads. */
+	DIRECT_IO_ALIGNMENT	= 4096,
+};
+
+/* Maps the pieces of a torrent onto the data files of the torrent.
+ *
+ * The torrent data is treated as a single stream, which is the concatenation of all files
+ * in the torrent, in torrent order. This stream is split into pieces of 'piece_length' bytes (the last piece
+ * may be shorter). A piece may span several files, and so each piece is described as a list of file segments. */
+class TorrentDataLayout
+{
+public:
+	struct File
+	{
+		QString name;
+		uint64_t length;
+		/* The offset of the file in the torrent data stream. */
+		uint64_t offset;
+	};
+	struct Segment
+	{
+		int file_index;
+		uint64_t file_offset;
+		uint64_t length;
+	};
+private:
+	std::vector<File> files;
+	uint64_t total_length = 0;
+	const uint64_t piece_length;
+public:
+	TorrentDataLayout(const QStringList & fileNames, const QList<uint64_t> & fileSizes, uint64_t piece_length) : piece_length(piece_length)
+	{
+		for (int i = 0; i < fileNames.length(); i ++)
+		{
+			files.push_back(File { fileNames.at(i), fileSizes.at(i), total_length });
+			total_length += fileSizes.at(i);
+		}
+	}
+	const std::vector<File> & fileList(void) const { return files; }
+	uint64_t totalLength(void) const { return total_length; }
+	uint64_t pieceLength(void) const { return piece_length; }
+	int64_t pieceCount(void) const { return (total_length + piece_length - 1) / piece_length; }
+	uint64_t pieceOffset(int64_t piece_index) const { return piece_index * piece_length; }
+	uint64_t pieceSize(int64_t piece_index) const { return std::min(piece_length, total_length - pieceOffset(piece_index)); }
+
+	/* Returns the index of the first file, which holds data at or after the specified offset in the torrent data stream. */
+	int fileAt(uint64_t offset) const
+	{
+		auto f = std::upper_bound(files.begin(), files.end(), offset, [] (uint64_t offset, const File & file) -> bool
+			{ return offset < file.offset + file.length; });
+		return f - files.begin();
+	}
+
+	/* Returns the file segments, which make up the specified piece. Zero-length files are not included. */
+	std::vector<Segment> pieceSegments(int64_t piece_index) const
+	{
+		std::vector<Segment> segments;
+		uint64_t offset = pieceOffset(piece_index), remaining = pieceSize(piece_index);
+		for (int i = fileAt(offset); remaining && i < (int) files.size(); i ++)
+		{
+			const File & f = files.at(i);
+			if (!f.length)
+				continue;
+			const uint64_t file_offset = offset - f.offset;
+			const uint64_t length = std::min(remaining, f.length - file_offset);
+			segments.push_back(Segment { i, file_offset, length });
+			offset += length;
+			remaining -= length;
+		}
+		return segments;
+	}
+};
+
+/* A fixed set of piece-sized buffers, which are allocated once and then reused for all pieces.
+ * Acquiring a buffer blocks while all buffers are in use, which also bounds the memory
+ * used for pieces in flight to 'buffer_count * piece_length'.
+ * The buffers are handed out as shared pointers, that return the buffer to the pool when released. */
+class PieceBufferPool
+{
+private:
+	struct AlignedDelete { void operator()(char * buffer) const { operator delete[](buffer, std::align_val_t(DIRECT_IO_ALIGNMENT)); } };
+	std::vector<std::unique_ptr<char[], AlignedDelete>> storage;
+	std::vector<char *> free_buffers;
+	std::mutex mutex;
+	std::condition_variable buffer_released;
+
+	void release(char * buffer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		free_buffers.push_back(buffer);
+		buffer_released.notify_one();
+	}
+public:
+	PieceBufferPool(uint64_t piece_length, unsigned buffer_count)
+	{
+		for (unsigned i = 0; i < std::max(buffer_count, 1u); i ++)
+		{
+			storage.emplace_back(static_cast<char *>(operator new[](piece_length, std::align_val_t(DIRECT_IO_ALIGNMENT))));
+			free_buffers.push_back(storage.back().get());
+		}
+	}
+	/* Note: all acquired buffers must be released before the pool is destroyed. */
+	std::shared_ptr<char> acquire(void)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		buffer_released.wait(lock, [&] { return free_buffers.size(); });
+		char * buffer = free_buffers.back();
+		free_buffers.pop_back();
+		return std::shared_ptr<char>(buffer, [this] (char * buffer) -> void { release(buffer); });
+	}
+};
+
+/* A data file, opened for reading. Depending on how it is opened, the file is either read into piece buffers,
+ * or memory-mapped in its entirety. Memory-mapped files are unmapped when the last reference to them is released.
+ *
+ * On Linux, the kernel is told that the file will be read sequentially, and the file may additionally be opened
+ * for direct (O_DIRECT) reads, which bypass the page cache. Direct reads are only possible when the file offset, the
+ * read length and the buffer address are all aligned, so a regular file handle is always kept open for any reads
+ * which are not aligned - e.g. the last piece of a file, or pieces that span several files. */
+class DataFile
+{
+private:
+	QFile file;
+	const uchar * mapping = 0;
+	int direct_handle = -1;
+public:
+	DataFile(const QString & name) : file(name) {}
+	~DataFile()
+	{
+		if (mapping)
+			file.unmap(const_cast<uchar *>(mapping));
+#ifdef Q_OS_LINUX
+		if (direct_handle != -1)
+			::close(direct_handle);
+#endif
+	}
+	const QString fileName(void) const { return file.fileName(); }
+	bool open(bool memoryMap, bool directIo = false)
+	{
+		/* Unbuffered, as the data is read directly into the piece buffers. */
+		if (!file.open(QFile::ReadOnly | QFile::Unbuffered))
+			return false;
+#ifdef Q_OS_LINUX
+		posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+		if (directIo && !memoryMap)
+			/* Not being able to open the file for direct reads is not an error, all reads then go through the page cache. */
+			direct_handle = ::open(file.fileName().toLocal8Bit().constData(), O_RDONLY | O_DIRECT);
+#else
+		Q_UNUSED(directIo)
+#endif
+		if (memoryMap && file.size())
+			return (mapping = file.map(0, file.size()));
+		return true;
+	}
+	/* Only valid for memory-mapped files. */
+	QByteArrayView view(uint64_t offset, uint64_t length) const { return QByteArrayView(reinterpret_cast<const char *>(mapping) + offset, length); }
+	/* Reads exactly 'length' bytes at 'offset' into 'buffer' - with a direct read, if the file has been opened for
+	 * direct reads, and the read is properly aligned. */
+	bool read(uint64_t offset, char * buffer, uint64_t length)
+	{
+#ifdef Q_OS_LINUX
+		if (direct_handle != -1 && handle(offset, buffer, length) == direct_handle)
+		{
+			while (length)
+			{
+				const ssize_t x = pread(direct_handle, buffer, length, offset);
+				if (x < 0 && errno == EINTR)
+					continue;
+				if (x <= 0)
+					return false;
+				buffer += x;
+				offset += x;
+				length -= x;
+			}
+			return true;
+		}
+#endif
+		if (!file.seek(offset))
+			return false;
+		return file.read(buffer, length) == (qint64) length;
+	}
+	/* Returns the native file handle to use for reading the specified range into the specified buffer -
+	 * the direct I/O handle if the file has been opened for direct reads, and the read is properly aligned. */
+	int handle(uint64_t offset, const char * buffer, uint64_t length) const
+	{
+		if (direct_handle != -1 && !(offset % DIRECT_IO_ALIGNMENT) && !(length % DIRECT_IO_ALIGNMENT)
+				&& !(reinterpret_cast<uintptr_t>(buffer) % DIRECT_IO_ALIGNMENT))
+			return direct_handle;
+		return file.handle();
+	}
+	/* Tells the kernel that the specified range of the file will not be needed again,
+	 * so that verifying large amounts of data does not evict everything else from the page cache. */
+	void dropCache(uint64_t offset, uint64_t length) const
+	{
+#ifdef Q_OS_LINUX
+		posix_fadvise(file.handle(), offset, length, POSIX_FADV_DONTNEED);
+#else
+		Q_UNUSED(offset) Q_UNUSED(length)
+#endif
+	}
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "PieceReader.hxx"
+
+/* Selects a random sample of the pieces of a torrent, for quick spot checks of the torrent data.
+ *
+ * The sample is drawn without replacement, with a pseudo-random generator seeded with the seed of the run and the
+ * info hash of the torrent, so that a run can be repeated exactly by specifying the same seed. The pieces are weighted:
+ * pieces at file boundaries (where truncated, shifted or partially written files show up) and pieces of recently modified
+ * files are more likely to be selected. The sample is returned in piece order, which is also data offset order,
+ * so that the sampled pieces are read with as few seeks as possible. */
+class PieceSampler
+{
+public:
+	enum
+	{
+		/* The weight of a piece holding the start or the end of a file, relative to other pieces. */
+		BOUNDARY_WEIGHT		= 4,
+		/* The weight of a piece of a file modified within 'RECENT_FILE_DAYS' days, relative to other pieces. */
+		RECENT_FILE_WEIGHT	= 4,
+		RECENT_FILE_DAYS	= 7,
+	};
+
+	/* Parses a sample specification - either a percentage of the pieces of each torrent (e.g. "2.5%"),
+	 * or a number of pieces per torrent (e.g. "100"). */
+	static bool parse(const QString & specification, double & fraction, int64_t & count)
+	{
+		bool ok;
+		fraction = 0;
+		count = 0;
+		if (specification.endsWith('%'))
+		{
+			QString percentage = specification;
+			percentage.chop(1);
+			fraction = percentage.toDouble(& ok) / 100.;
+			return ok && fraction > 0 && fraction <= 1;
+		}
+		count = specification.toLongLong(& ok);
+		return ok && count > 0;
+	}
+
+	/* Returns the number of pieces to sample, out of 'candidate_count' pieces. */
+	static int64_t sampleSize(int64_t candidate_count, double fraction, int64_t count)
+	{
+		if (fraction)
+			count = std::max((int64_t) std::ceil(fraction * candidate_count), (int64_t) 1);
+		return std::min(count, candidate_count);
+	}
+
+	/* Selects 'sample_size' pieces out of the candidate pieces, returned sorted by piece index. */
+	static std::vector<int64_t> select(const TorrentDataLayout & layout, const std::vector<int64_t> & candidates, int64_t sample_size,
+			uint64_t seed, const QByteArray & info_hash)
+	{
+		if (sample_size >= (int64_t) candidates.size())
+			return candidates;
+
+		/* A piece at the boundary of several (small) files is weighted as a single boundary piece. */
+		std::vector<unsigned> pieceWeights(layout.pieceCount(), 1);
+		std::vector<bool> boundary(layout.pieceCount(), false);
+		const qint64 recent = QDateTime::currentSecsSinceEpoch() - RECENT_FILE_DAYS * 24 * 3600;
+		for (const auto & f : layout.fileList())
+		{
+			if (!f.length)
+				continue;
+			const int64_t first_piece = f.offset / layout.pieceLength(), last_piece = (f.offset + f.length - 1) / layout.pieceLength();
+			if (QFileInfo(f.name).lastModified().toSecsSinceEpoch() >= recent)
+				for (int64_t piece_index = first_piece; piece_index <= last_piece; piece_index ++)
+					pieceWeights[piece_index] = std::max(pieceWeights.at(piece_index), (unsigned) RECENT_FILE_WEIGHT);
+			boundary[first_piece] = boundary[last_piece] = true;
+		}
+		for (int64_t piece_index = 0; piece_index < layout.pieceCount(); piece_index ++)
+			if (boundary.at(piece_index))
+				pieceWeights[piece_index] *= BOUNDARY_WEIGHT;
+
+		uint64_t torrent_seed = 0;
+		memcpy(& torrent_seed, info_hash.constData(), std::min(sizeof torrent_seed, (size_t) info_hash.size()));
+		std::mt19937_64 generator(seed ^ torrent_seed);
+		std::uniform_real_distribution<double> uniform(0, 1);
+
+		/* Weighted sampling without replacement (Efraimidis and Spirakis) - each piece gets the key u^(1/w),
+		 * for a uniformly distributed u, and the pieces with the largest keys are selected. */
+		std::vector<std::pair<double, int64_t>> keys;
+		keys.reserve(candidates.size());
+		for (const auto piece_index : candidates)
+			keys.push_back(std::make_pair(std::log(uniform(generator)) / pieceWeights.at(piece_index), piece_index));
+		std::nth_element(keys.begin(), keys.begin() + sample_size, keys.end(), std::greater<std::pair<double, int64_t>>());
+
+		std::vector<int64_t> sample;
+		for (int64_t i = 0; i < sample_size; i ++)
+			sample.push_back(keys.at(i).second);
+		std::sort(sample.begin(), sample.end());
+		return sample;
+	}
+
+	/* Returns the upper bound of the rate of corrupted pieces, with the specified confidence (e.g. 0.95), after finding
+	 * 'corrupted' corrupted pieces in a sample of 'sampled' pieces. This is the one-sided Clopper-Pearson bound, which
+	 * assumes that the sample is representative; as boundary pieces and pieces of recently modified files are
+	 * oversampled, the bound is conservative for the corruption that these pieces are most likely to show. */
+	static double corruptionRateUpperBound(uint64_t sampled, uint64_t corrupted, double confidence)
+	{
+		if (!sampled || corrupted >= sampled)
+			return 1;
+		/* The probability of finding at most 'corrupted' corrupted pieces, if the rate of corrupted pieces is 'p'. */
+		std::function<double(double p)> binomialCdf = [&] (double p) -> double {
+			double sum = 0;
+			for (uint64_t i = 0; i <= corrupted; i ++)
+				sum += std::exp(std::lgamma(sampled + 1.) - std::lgamma(i + 1.) - std::lgamma(sampled - i + 1.)
+						+ i * std::log(p) + (sampled - i) * std::log1p(-p));
+			return sum;
+		};
+		double low = (double) corrupted / sampled, high = 1;
+		for (int i = 0; i < 64; i ++)
+		{
+			const double p = (low + high) / 2;
+			(binomialCdf(p) > 1 - confidence ? low : high) = p;
+		}
+		return high;
+	}
+};
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QDebug>
+
+#include <atomic>
+#include <cstring>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Metrics.hxx"
+#include "PieceReader.hxx"
+#include "ReadThrottle.hxx"
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+/* A single read of a range of a data file into a buffer. */
+struct ReadRequest
+{
+	DataFile *	file;
+	uint64_t	offset;
+	char *		buffer;
+	uint64_t	length;
+	bool		ok = false;
+};
+
+/* The interface of the data reading backends.
+ *
+ * A batch of read requests is handed to the engine at once. The engine may execute the requests in the batch
+ * concurrently, and in any order, and returns when all of them have completed. This allows the asynchronous
+ * engines to keep several reads in flight, while the caller still processes the pieces strictly in order. */
+class ReadEngine
+{
+protected:
+	const bool drop_cache;
+	ReadThrottle & throttle = ReadThrottle::instance();
+	/* The time that the reads of this engine have waited to be issued, in nanoseconds. */
+	std::atomic<uint64_t> throttled_ns { 0 };
+	void completed(ReadRequest & request)
+	{
+		if (request.ok && drop_cache)
+			request.file->dropCache(request.offset, request.length);
+	}
+	/* Waits until a read may be issued, if reads are throttled. */
+	void throttleRead(uint64_t length)
+	{
+		if (throttle.isActive())
+			throttled_ns += throttle.acquire(length);
+	}
+	/* Records the latency of a completed read. */
+	void readCompleted(uint64_t latency_ns)
+	{
+		Metrics::instance().record(Metrics::READ, latency_ns);
+		if (throttle.isActive())
+			throttle.release(latency_ns);
+	}
+public:
+	ReadEngine(bool drop_cache) : drop_cache(drop_cache) {}
+	virtual ~ReadEngine() {}
+	virtual const char * name(void) const = 0;
+	/* The number of reads that the engine can usefully keep in flight. */
+	virtual unsigned queueDepth(void) const = 0;
+	/* Executes all requests, and returns true if all of them succeeded. */
+	virtual bool read(std::vector<ReadRequest> & requests) = 0;
+	uint64_t throttledNs(void) const { return throttled_ns; }
+
+	static QStringList engineNames(void)
+	{
+		QStringList names("sync");
+#ifdef Q_OS_UNIX
+		names << "pread";
+#endif
+#ifdef HAVE_IO_URING
+		names << "uring";
+#endif
+		return names;
+	}
+	static std::unique_ptr<ReadEngine> create(const QString & name, unsigned queue_depth, bool drop_cache);
+};
+
+/* Issues one blocking read at a time. This is portable, and is the default engine. */
+class SyncReadEngine : public ReadEngine
+{
+public:
+	SyncReadEngine(bool drop_cache) : ReadEngine(drop_cache) {}
+	const char * name(void) const override { return "sync"; }
+	unsigned queueDepth(void) const override { return 1; }
+	bool read(std::vector<ReadRequest> & requests) override
+	{
+		bool result = true;
+		for (auto & request : requests)
+		{
+			throttleRead(request.length);
+			const uint64_t start = Metrics::now();
+			result &= (request.ok = request.file->read(request.offset, request.buffer, request.length));
+			readCompleted(Metrics::now() - start);
+			completed(request);
+		}
+		return result;
+	}
+};
+
+#ifdef Q_OS_UNIX
+
+/* Reads exactly 'length' bytes, retrying interrupted and short reads. */
+static inline bool preadFully(int handle, char * buffer, uint64_t length, uint64_t offset)
+{
+	while (length)
+	{
+		ssize_t x = pread(handle, buffer, length, offset);
+		if (x < 0 && errno == EINTR)
+			continue;
+		if (x <= 0)
+			return false;
+		buffer += x;
+		offset += x;
+		length -= x;
+	}
+	return true;
+}
+
+/* Executes the reads of a batch concurrently, with a pool of threads issuing blocking 'pread()' calls. */
+class ThreadPoolReadEngine : public ReadEngine
+{
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable batch_available, batch_done;
+	std::vector<ReadRequest> * batch = 0;
+	size_t next_request = 0, completed_requests = 0;
+	bool stop = false;
+
+	void worker(void)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (1)
+		{
+			batch_available.wait(lock, [&] { return stop || (batch && next_request < batch->size()); });
+			if (stop)
+				return;
+			ReadRequest & request = batch->at(next_request ++);
+			lock.unlock();
+			throttleRead(request.length);
+			const uint64_t start = Metrics::now();
+			request.ok = preadFully(request.file->handle(request.offset, request.buffer, request.length), request.buffer, request.length, request.offset);
+			readCompleted(Metrics::now() - start);
+			completed(request);
+			lock.lock();
+			if (++ completed_requests == batch->size())
+				batch_done.notify_all();
+		}
+	}
+public:
+	ThreadPoolReadEngine(unsigned thread_count, bool drop_cache) : ReadEngine(drop_cache)
+	{
+		for (unsigned i = 0; i < std::max(thread_count, 1u); i ++)
+			threads.emplace_back(& ThreadPoolReadEngine::worker, this);
+	}
+	~ThreadPoolReadEngine()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+			batch_available.notify_all();
+		}
+		for (auto & t : threads)
+			t.join();
+	}
+	const char * name(void) const override { return "pread"; }
+	unsigned queueDepth(void) const override { return threads.size(); }
+	bool read(std::vector<ReadRequest> & requests) override
+	{
+		if (!requests.size())
+			return true;
+		std::unique_lock<std::mutex> lock(mutex);
+		batch = & requests;
+		next_request = completed_requests = 0;
+		batch_available.notify_all();
+		batch_done.wait(lock, [&] { return completed_requests == requests.size(); });
+		batch = 0;
+		bool result = true;
+		for (const auto & request : requests)
+			result &= request.ok;
+		return result;
+	}
+};
+
+#endif /* Q_OS_UNIX */
+
+#ifdef HAVE_IO_URING
+
+/* Keeps up to 'queue depth' reads in flight with the Linux io_uring interface.
+ * The raw system call interface is used, so that there is no dependency on liburing. */
+class IoUringReadEngine : public ReadEngine
+{
+private:
+	int ring_handle = -1;
+	unsigned entries = 0;
+	void * sq_ring = MAP_FAILED, * cq_ring = MAP_FAILED;
+	size_t sq_ring_size = 0, cq_ring_size = 0;
+	struct io_uring_sqe * sqes = (struct io_uring_sqe *) MAP_FAILED;
+	unsigned * sq_tail, * sq_mask, * sq_array;
+	unsigned * cq_head, * cq_tail, * cq_mask;
+	struct io_uring_cqe * cqes;
+
+	template <typename T> static T * at(void * ring, unsigned offset) { return reinterpret_cast<T *>(static_cast<char *>(ring) + offset); }
+public:
+	IoUringReadEngine(unsigned queue_depth, bool drop_cache) : ReadEngine(drop_cache)
+	{
+		struct io_uring_params params = {};
+		if ((ring_handle = syscall(__NR_io_uring_setup, std::max(queue_depth, 1u), & params)) < 0)
+			return;
+		entries = params.sq_entries;
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		sq_ring = mmap(0, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_handle, IORING_OFF_SQ_RING);
+		if (sq_ring == MAP_FAILED)
+			return;
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			cq_ring = sq_ring;
+		else if ((cq_ring = mmap(0, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_handle, IORING_OFF_CQ_RING)) == MAP_FAILED)
+			return;
+		sqes = (struct io_uring_sqe *) mmap(0, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_handle, IORING_OFF_SQES);
+		sq_tail = at<unsigned>(sq_ring, params.sq_off.tail);
+		sq_mask = at<unsigned>(sq_ring, params.sq_off.ring_mask);
+		sq_array = at<unsigned>(sq_ring, params.sq_off.array);
+		cq_head = at<unsigned>(cq_ring, params.cq_off.head);
+		cq_tail = at<unsigned>(cq_ring, params.cq_off.tail);
+		cq_mask = at<unsigned>(cq_ring, params.cq_off.ring_mask);
+		cqes = at<struct io_uring_cqe>(cq_ring, params.cq_off.cqes);
+	}
+	~IoUringReadEngine()
+	{
+		if (sqes != MAP_FAILED)
+			munmap(sqes, entries * sizeof(struct io_uring_sqe));
+		if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+			munmap(cq_ring, cq_ring_size);
+		if (sq_ring != MAP_FAILED)
+			munmap(sq_ring, sq_ring_size);
+		if (ring_handle >= 0)
+			::close(ring_handle);
+	}
+	/* Returns false if the kernel does not support io_uring, or if io_uring is disabled. */
+	bool isValid(void) const { return ring_handle >= 0 && sq_ring != MAP_FAILED && cq_ring != MAP_FAILED && sqes != MAP_FAILED; }
+	const char * name(void) const override { return "uring"; }
+	unsigned queueDepth(void) const override { return entries; }
+	bool read(std::vector<ReadRequest> & requests) override
+	{
+		/* The progress of each request - short reads are resubmitted for the remaining data. */
+		std::vector<uint64_t> done(requests.size(), 0);
+		std::vector<struct iovec> iovecs(requests.size());
+		std::vector<size_t> pending;
+		for (size_t i = requests.size(); i; i --)
+			pending.push_back(i - 1);
+		/* The read latency is measured from the first submission of a request. */
+		std::vector<uint64_t> submitted(requests.size(), 0);
+		unsigned in_flight = 0, unsubmitted = 0;
+		bool result = true;
+		/* Takes the completed requests from the completion queue. Requests, which have been interrupted, or only partially
+		 * read, are resubmitted if 'resubmit' is set, otherwise they fail. */
+		auto reap = [&] (bool resubmit) -> void {
+			unsigned head = * cq_head;
+			while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+			{
+				const struct io_uring_cqe * cqe = & cqes[head & * cq_mask];
+				const size_t i = cqe->user_data;
+				ReadRequest & r = requests.at(i);
+				in_flight --;
+				if (resubmit && (cqe->res == -EINTR || cqe->res == -EAGAIN))
+					pending.push_back(i);
+				else if (cqe->res <= 0)
+				{
+					result = r.ok = false;
+					readCompleted(Metrics::now() - submitted.at(i));
+				}
+				else if ((done.at(i) += cqe->res) < r.length)
+				{
+					if (resubmit)
+						pending.push_back(i);
+					else
+					{
+						r.ok = false;
+						readCompleted(Metrics::now() - submitted.at(i));
+					}
+				}
+				else
+				{
+					r.ok = true;
+					readCompleted(Metrics::now() - submitted.at(i));
+					completed(r);
+				}
+				head ++;
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		};
+
+		while (pending.size() || in_flight)
+		{
+			unsigned tail = * sq_tail;
+			while (pending.size() && in_flight < entries)
+			{
+				const size_t i = pending.back();
+				ReadRequest & r = requests.at(i);
+				if (!submitted.at(i) && throttle.isActive())
+				{
+					/* Only wait for the throttle when no reads are in flight, otherwise submit the request later. */
+					if (!in_flight)
+						throttled_ns += throttle.acquireSlot();
+					else if (!throttle.tryAcquireSlot())
+						break;
+					throttled_ns += throttle.acquireRate(r.length);
+				}
+				pending.pop_back();
+				iovecs.at(i).iov_base = r.buffer + done.at(i);
+				iovecs.at(i).iov_len = r.length - done.at(i);
+				const unsigned index = tail & * sq_mask;
+				struct io_uring_sqe * sqe = & sqes[index];
+				memset(sqe, 0, sizeof * sqe);
+				sqe->opcode = IORING_OP_READV;
+				sqe->fd = r.file->handle(r.offset + done.at(i), r.buffer + done.at(i), r.length - done.at(i));
+				sqe->addr = reinterpret_cast<uint64_t>(& iovecs.at(i));
+				sqe->len = 1;
+				sqe->off = r.offset + done.at(i);
+				sqe->user_data = i;
+				if (!submitted.at(i))
+					submitted.at(i) = Metrics::now();
+				sq_array[index] = index;
+				tail ++;
+				in_flight ++;
+				unsubmitted ++;
+			}
+			__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+			int x = syscall(__NR_io_uring_enter, ring_handle, unsubmitted, 1, IORING_ENTER_GETEVENTS, 0, 0);
+			if (x < 0)
+			{
+				if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+					continue;
+				qCritical() << "io_uring_enter() failed, errno:" << errno;
+				/* The requests in flight refer to the buffers of the caller, and to 'iovecs', so take back the requests
+				 * which the kernel has not taken, and wait for the others to complete, before returning. */
+				const unsigned taken = tail - unsubmitted;
+				for (; unsubmitted; unsubmitted --, in_flight --)
+					pending.push_back(sqes[(tail - unsubmitted) & * sq_mask].user_data);
+				__atomic_store_n(sq_tail, taken, __ATOMIC_RELEASE);
+				while (in_flight)
+				{
+					if (syscall(__NR_io_uring_enter, ring_handle, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+						qFatal("io_uring_enter() failed while reads are in flight, errno: %d", errno);
+					reap(false);
+				}
+				/* Release the throttle slots of the requests, which have been submitted, but have not completed. */
+				for (const auto i : pending)
+				{
+					requests.at(i).ok = false;
+					if (submitted.at(i))
+						readCompleted(Metrics::now() - submitted.at(i));
+				}
+				return false;
+			}
+			unsubmitted -= x;
+			reap(true);
+		}
+		return result;
+	}
+};
+
+#endif /* HAVE_IO_URING */
+
+inline std::unique_ptr<ReadEngine> ReadEngine::create(const QString & name, unsigned queue_depth, bool drop_cache)
+{
+#ifdef HAVE_IO_URING
+	if (name == "uring")
+	{
+		std::unique_ptr<IoUringReadEngine> engine = std::make_unique<IoUringReadEngine>(queue_depth, drop_cache);
+		if (engine->isValid())
+			return engine;
+		qCritical() << "io_uring is not available, falling back to the 'pread' read engine.";
+		return std::make_unique<ThreadPoolReadEngine>(queue_depth, drop_cache);
+	}
+#endif
+#ifdef Q_OS_UNIX
+	if (name == "pread")
+		return std::make_unique<ThreadPoolReadEngine>(queue_depth, drop_cache);
+#endif
+	if (name == "sync")
+		return std::make_unique<SyncReadEngine>(drop_cache);
+	return 0;
+}
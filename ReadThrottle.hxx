@@ -0,0 +1,160 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Metrics.hxx"
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Limits the rate and the concurrency of the data reads of all read engines in the process (and so of all torrents
+ * verified concurrently), so that verification can run on busy hosts, without starving other users of the disks.
+ *
+ * The rate limit is a token bucket, which is refilled at the maximum read rate, and holds up to 'BURST_MS' worth of
+ * tokens. A read takes as many tokens as it reads bytes; if there are not enough tokens, the bucket goes into debt,
+ * and the read waits until the debt has been paid off, so reads larger than the bucket are limited correctly, too.
+ *
+ * In adaptive mode, the number of reads in flight is limited as well, which limits both the queue depth of the
+ * asynchronous read engines and the number of threads reading at the same time. The limit is adjusted from the read
+ * latency, at most every 'ADJUST_INTERVAL_MS' milliseconds: it is halved while the (smoothed) latency is above the target,
+ * and increased by one while the latency is below half the target - that is, while the devices are mostly idle.
+ *
+ * The time that reads wait for tokens, or for their turn to be issued, is reported as throttled time.
+ * Memory-mapped data is read by page faults, while it is being hashed, so it is rate-limited per piece, and it is not
+ * covered by the adaptive limit. */
+class ReadThrottle
+{
+public:
+	enum
+	{
+		BURST_MS		= 100,
+		ADJUST_INTERVAL_MS	= 250,
+		DEFAULT_TARGET_LATENCY_MS	= 50,
+	};
+private:
+	std::mutex mutex;
+	std::condition_variable slot_available;
+	/* In bytes per second, 0 - unlimited. */
+	double rate = 0;
+	double tokens = 0;
+	uint64_t last_refill_ns = 0;
+	bool adaptive = false;
+	uint64_t target_latency_ns = 0;
+	unsigned max_in_flight = 1, limit = 1, in_flight = 0;
+	double latency_ns = 0;
+	uint64_t last_adjustment_ns = 0;
+	bool active = false;
+
+	ReadThrottle(void) {}
+	void throttled(uint64_t nanoseconds) { Metrics::instance().read_throttled_ns += nanoseconds; }
+public:
+	static ReadThrottle & instance(void)
+	{
+		static ReadThrottle throttle;
+		return throttle;
+	}
+	/* Must be called before any data is read. 'max_bytes_per_second' 0 - no rate limit; 'max_in_flight' - the upper bound
+	 * of the adaptive limit of reads in flight. */
+	void configure(double max_bytes_per_second, bool adaptive, unsigned target_latency_ms, unsigned max_in_flight)
+	{
+		rate = max_bytes_per_second;
+		tokens = rate * BURST_MS / 1000.;
+		last_refill_ns = Metrics::now();
+		this->adaptive = adaptive;
+		target_latency_ns = (uint64_t) target_latency_ms * 1000000;
+		this->max_in_flight = limit = std::max(max_in_flight, 1u);
+		Metrics::instance().read_concurrency_limit = adaptive ? limit : 0;
+		active = rate > 0 || adaptive;
+	}
+	bool isActive(void) const { return active; }
+
+	/* Waits for the tokens for a read of 'length' bytes. Returns the time waited, in nanoseconds. */
+	uint64_t acquireRate(uint64_t length)
+	{
+		if (!rate)
+			return 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		const uint64_t now = Metrics::now();
+		tokens = std::min(tokens + (now - last_refill_ns) * rate / 1e9, rate * BURST_MS / 1000.);
+		last_refill_ns = now;
+		tokens -= length;
+		if (tokens >= 0)
+			return 0;
+		const uint64_t wait_ns = -tokens / rate * 1e9;
+		lock.unlock();
+		std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+		throttled(wait_ns);
+		return wait_ns;
+	}
+	/* Waits until another read may be in flight. Returns the time waited, in nanoseconds.
+	 * Each read, which has been let in flight, must be reported with 'release()' when it completes. */
+	uint64_t acquireSlot(void)
+	{
+		if (!adaptive)
+			return 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		uint64_t waited = 0;
+		if (in_flight >= limit)
+		{
+			const uint64_t start = Metrics::now();
+			slot_available.wait(lock, [&] { return in_flight < limit; });
+			throttled(waited = Metrics::now() - start);
+		}
+		in_flight ++;
+		return waited;
+	}
+	/* Lets another read in flight, if the limit allows it, without waiting. */
+	bool tryAcquireSlot(void)
+	{
+		if (!adaptive)
+			return true;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (in_flight >= limit)
+			return false;
+		in_flight ++;
+		return true;
+	}
+	/* Waits for the tokens, and for a slot, for a read of 'length' bytes. Returns the time waited, in nanoseconds. */
+	uint64_t acquire(uint64_t length) { return acquireSlot() + acquireRate(length); }
+	/* Reports the completion of a read, which took 'read_latency_ns' nanoseconds, and adjusts the adaptive limit. */
+	void release(uint64_t read_latency_ns)
+	{
+		if (!adaptive)
+			return;
+		std::lock_guard<std::mutex> lock(mutex);
+		in_flight --;
+		latency_ns = latency_ns ? latency_ns + (read_latency_ns - latency_ns) / 8 : read_latency_ns;
+		const uint64_t now = Metrics::now();
+		if (now - last_adjustment_ns >= (uint64_t) ADJUST_INTERVAL_MS * 1000000)
+		{
+			if (latency_ns > target_latency_ns)
+				limit = std::max(limit / 2, 1u);
+			else if (latency_ns < target_latency_ns / 2 && limit < max_in_flight)
+				limit ++;
+			last_adjustment_ns = now;
+			Metrics::instance().read_concurrency_limit = limit;
+		}
+		slot_available.notify_all();
+	}
+
+	/* Puts the process (and the threads it creates afterwards) into the idle I/O scheduling class, so that its reads are
+	 * only served when no other process is using the disk. This is honored by the BFQ I/O scheduler. */
+	static bool setIdleIoPriority(void)
+	{
+#if defined Q_OS_LINUX && defined SYS_ioprio_set
+		enum { IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3, IOPRIO_CLASS_SHIFT = 13, };
+		return !syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#else
+		return false;
+#endif
+	}
+};
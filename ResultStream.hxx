@@ -0,0 +1,81 @@
+#pragma once
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QDebug>
+
+#include <mutex>
+
+#include <stdio.h>
+
+/* A machine-readable stream of verification results, in JSON lines format - one JSON object per line.
+ *
+ * A "piece" record is written for each corrupted piece, as soon as it is found:
+ *
+ *	{"type":"piece","torrent":<torrent file>,"piece":<piece index>,"files":[<affected files>]}
+ *
+ * and a "torrent" record is written for each torrent, in the order of the torrent list, when the torrent has been processed:
+ *
+ *	{"type":"torrent","torrent":<torrent file>,"info_hash":<hex>,"status":"ok"|"corrupted"|"error",
+ *	 "sha1_corrupted_files":[...],"sha256_corrupted_files":[...],"md5_corrupted_files":[...],"hashed_bytes":<n>,"seconds":<s>}
+ *
+ * Status "error" means that the torrent data could not be verified at all (e.g. missing files, or wrong file sizes).
+ * Piece records for torrents verified concurrently may be interleaved. Each record is flushed when written. */
+class ResultStream
+{
+private:
+	QFile file;
+	std::mutex mutex;
+
+	void write(const QJsonObject & record)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+		file.flush();
+	}
+public:
+	/* Opens the stream; the file name "-" is the standard output. */
+	bool open(const QString & fileName)
+	{
+		bool ok;
+		if (fileName == "-")
+			ok = file.open(stdout, QFile::WriteOnly);
+		else
+		{
+			file.setFileName(fileName);
+			ok = file.open(QFile::WriteOnly | QFile::Truncate);
+		}
+		if (!ok)
+			qCritical() << "Can not open results file for writing:" << fileName;
+		return ok;
+	}
+	bool isOpen(void) const { return file.isOpen(); }
+
+	void corruptedPiece(const QString & torrent_file, int64_t piece_index, const QStringList & files)
+	{
+		QJsonObject record;
+		record["type"] = "piece";
+		record["torrent"] = torrent_file;
+		record["piece"] = (qint64) piece_index;
+		record["files"] = QJsonArray::fromStringList(files);
+		write(record);
+	}
+	void torrent(const QString & torrent_file, const QByteArray & info_hash, bool verified,
+			const QStringList & sha1_failures, const QStringList & sha256_failures, const QStringList & md5_failures, uint64_t hashed_bytes, double seconds)
+	{
+		QJsonObject record;
+		record["type"] = "torrent";
+		record["torrent"] = torrent_file;
+		record["info_hash"] = QString(info_hash.toHex());
+		record["status"] = verified ? "ok" : sha1_failures.length() || sha256_failures.length() || md5_failures.length() ? "corrupted" : "error";
+		record["sha1_corrupted_files"] = QJsonArray::fromStringList(sha1_failures);
+		record["sha256_corrupted_files"] = QJsonArray::fromStringList(sha256_failures);
+		record["md5_corrupted_files"] = QJsonArray::fromStringList(md5_failures);
+		record["hashed_bytes"] = (qint64) hashed_bytes;
+		record["seconds"] = seconds;
+		write(record);
+	}
+};
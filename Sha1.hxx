@@ -0,0 +1,582 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCryptographicHash>
+#include <QStringList>
+#include <QDebug>
+
+#include <cstring>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_X86_KERNELS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#define SHA1_ARMV8_KERNEL
+#include <arm_neon.h>
+#if defined(Q_OS_LINUX)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+/* SHA1 hashing of torrent pieces, with a choice of compression kernels:
+ *
+ * - 'qt'	- QCryptographicHash, the portable reference implementation
+ * - 'generic'	- a portable C++ implementation of the SHA1 compression function
+ * - 'shani'	- the x86 SHA extensions
+ * - 'armv8'	- the ARMv8 cryptography extensions
+ * - 'avx2'	- an AVX2 multi-buffer kernel, which hashes up to 8 independent pieces at once;
+ * 		  single pieces are hashed with the best available single-buffer kernel
+ *
+ * The kernel is selected once, at startup, from the features of the CPU that the program runs on ('auto'),
+ * or explicitly by name. Pieces are given as lists of segments, and are hashed without being copied
+ * into contiguous memory. */
+class Sha1
+{
+public:
+	enum
+	{
+		DIGEST_SIZE	= 20,
+		BLOCK_SIZE	= 64,
+		MAX_LANES	= 8,
+	};
+	/* Processes 'block_count' consecutive 64 byte blocks. */
+	typedef void (* CompressFunction)(uint32_t state[5], const uchar * blocks, size_t block_count);
+	/* Processes 'block_count' consecutive 64 byte blocks in each of MAX_LANES independent messages.
+	 * The states are stored lane-interleaved - state[word][lane]. */
+	typedef void (* MultiBufferCompressFunction)(uint32_t state[5][MAX_LANES], const uchar * const lanes[MAX_LANES], size_t block_count);
+
+	typedef std::vector<QByteArrayView> Segments;
+
+private:
+	struct Kernel
+	{
+		const char * name;
+		/* Null for the 'qt' kernel. */
+		CompressFunction compress;
+		MultiBufferCompressFunction compress_multi_buffer;
+	};
+
+	static inline uint32_t rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+	static inline uint32_t loadBigEndian(const uchar * p) { return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3]; }
+
+	static void compressGeneric(uint32_t state[5], const uchar * blocks, size_t block_count)
+	{
+		for (; block_count --; blocks += BLOCK_SIZE)
+		{
+			uint32_t w[16];
+			for (int i = 0; i < 16; i ++)
+				w[i] = loadBigEndian(blocks + 4 * i);
+			uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+			for (int i = 0; i < 80; i ++)
+			{
+				if (i >= 16)
+					w[i & 15] = rol(w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15], 1);
+				uint32_t f, k;
+				if (i < 20)
+					f = (b & c) | (~b & d), k = 0x5a827999;
+				else if (i < 40)
+					f = b ^ c ^ d, k = 0x6ed9eba1;
+				else if (i < 60)
+					f = (b & c) | (b & d) | (c & d), k = 0x8f1bbcdc;
+				else
+					f = b ^ c ^ d, k = 0xca62c1d6;
+				const uint32_t t = rol(a, 5) + f + e + k + w[i & 15];
+				e = d, d = c, c = rol(b, 30), b = a, a = t;
+			}
+			state[0] += a, state[1] += b, state[2] += c, state[3] += d, state[4] += e;
+		}
+	}
+
+#ifdef SHA1_X86_KERNELS
+	__attribute__((target("sha,sse4.1,ssse3")))
+	static void compressShaNi(uint32_t state[5], const uchar * blocks, size_t block_count)
+	{
+		const __m128i byte_swap_mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+		__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1b);
+		__m128i e0 = _mm_set_epi32(state[4], 0, 0, 0), e1;
+		__m128i m[4];
+
+		for (; block_count --; blocks += BLOCK_SIZE)
+		{
+			const __m128i abcd_saved = abcd, e0_saved = e0;
+			for (int i = 0; i < 4; i ++)
+				m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (blocks + 16 * i)), byte_swap_mask);
+
+			/* Four rounds per step; 'e0' and 'e1' alternate as the 'e' input of the rounds, and the message schedule
+			 * is computed in place in m[0..3]. The 'g' argument must be a constant, it selects the round function. */
+#define SHA1_SHANI_STEP(g)											\
+			{												\
+				__m128i & e = ((g) & 1) ? e1 : e0, & e_next = ((g) & 1) ? e0 : e1;			\
+				if ((g) == 0)										\
+					e = _mm_add_epi32(e, m[0]);							\
+				else											\
+					e = _mm_sha1nexte_epu32(e, m[(g) & 3]);						\
+				e_next = abcd;										\
+				if ((g) >= 3 && (g) <= 18)								\
+					m[((g) + 1) & 3] = _mm_sha1msg2_epu32(m[((g) + 1) & 3], m[(g) & 3]);		\
+				abcd = _mm_sha1rnds4_epu32(abcd, e, (g) / 5);						\
+				if ((g) >= 1 && (g) <= 16)								\
+					m[((g) + 3) & 3] = _mm_sha1msg1_epu32(m[((g) + 3) & 3], m[(g) & 3]);		\
+				if ((g) >= 2 && (g) <= 17)								\
+					m[((g) + 2) & 3] = _mm_xor_si128(m[((g) + 2) & 3], m[(g) & 3]);		\
+			}
+			SHA1_SHANI_STEP(0) SHA1_SHANI_STEP(1) SHA1_SHANI_STEP(2) SHA1_SHANI_STEP(3) SHA1_SHANI_STEP(4)
+			SHA1_SHANI_STEP(5) SHA1_SHANI_STEP(6) SHA1_SHANI_STEP(7) SHA1_SHANI_STEP(8) SHA1_SHANI_STEP(9)
+			SHA1_SHANI_STEP(10) SHA1_SHANI_STEP(11) SHA1_SHANI_STEP(12) SHA1_SHANI_STEP(13) SHA1_SHANI_STEP(14)
+			SHA1_SHANI_STEP(15) SHA1_SHANI_STEP(16) SHA1_SHANI_STEP(17) SHA1_SHANI_STEP(18) SHA1_SHANI_STEP(19)
+#undef SHA1_SHANI_STEP
+
+			e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+			abcd = _mm_add_epi32(abcd, abcd_saved);
+		}
+		_mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1b));
+		state[4] = _mm_extract_epi32(e0, 3);
+	}
+
+	__attribute__((target("avx2")))
+	static inline __m256i rol8(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+	/* Loads 32 bytes from each of the 8 lanes, and transposes them, so that w[i] holds the i-th big-endian word of all lanes. */
+	__attribute__((target("avx2")))
+	static inline void loadTransposed8(__m256i w[8], const uchar * const lanes[MAX_LANES], size_t offset)
+	{
+		const __m256i byte_swap_mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+				12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+		__m256i r[8], s[8];
+		for (int i = 0; i < 8; i ++)
+			r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (lanes[i] + offset)), byte_swap_mask);
+		for (int i = 0; i < 8; i += 2)
+		{
+			s[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+			s[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+		}
+		for (int i = 0; i < 8; i += 4)
+		{
+			r[i] = _mm256_unpacklo_epi64(s[i], s[i + 2]);
+			r[i + 1] = _mm256_unpackhi_epi64(s[i], s[i + 2]);
+			r[i + 2] = _mm256_unpacklo_epi64(s[i + 1], s[i + 3]);
+			r[i + 3] = _mm256_unpackhi_epi64(s[i + 1], s[i + 3]);
+		}
+		for (int i = 0; i < 4; i ++)
+		{
+			w[i] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20);
+			w[i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31);
+		}
+	}
+
+	__attribute__((target("avx2")))
+	static void compressAvx2MultiBuffer(uint32_t state[5][MAX_LANES], const uchar * const lanes[MAX_LANES], size_t block_count)
+	{
+		__m256i h[5];
+		for (int i = 0; i < 5; i ++)
+			h[i] = _mm256_loadu_si256((const __m256i *) state[i]);
+		const __m256i k[4] = { _mm256_set1_epi32(0x5a827999), _mm256_set1_epi32(0x6ed9eba1), _mm256_set1_epi32(0x8f1bbcdc), _mm256_set1_epi32(0xca62c1d6) };
+
+		for (size_t block = 0; block < block_count; block ++)
+		{
+			__m256i w[16];
+			loadTransposed8(w, lanes, block * BLOCK_SIZE);
+			loadTransposed8(w + 8, lanes, block * BLOCK_SIZE + 32);
+			__m256i a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+			for (int i = 0; i < 80; i ++)
+			{
+				if (i >= 16)
+					w[i & 15] = rol8(_mm256_xor_si256(_mm256_xor_si256(w[(i - 3) & 15], w[(i - 8) & 15]),
+							_mm256_xor_si256(w[(i - 14) & 15], w[i & 15])), 1);
+				__m256i f;
+				if (i < 20)
+					f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+				else if (i < 40 || i >= 60)
+					f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+				else
+					f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+				const __m256i t = _mm256_add_epi32(_mm256_add_epi32(rol8(a, 5), f),
+						_mm256_add_epi32(_mm256_add_epi32(e, k[i / 20]), w[i & 15]));
+				e = d, d = c, c = rol8(b, 30), b = a, a = t;
+			}
+			h[0] = _mm256_add_epi32(h[0], a);
+			h[1] = _mm256_add_epi32(h[1], b);
+			h[2] = _mm256_add_epi32(h[2], c);
+			h[3] = _mm256_add_epi32(h[3], d);
+			h[4] = _mm256_add_epi32(h[4], e);
+		}
+		for (int i = 0; i < 5; i ++)
+			_mm256_storeu_si256((__m256i *) state[i], h[i]);
+	}
+
+	static bool cpuHasShaNi(void)
+	{
+		unsigned eax, ebx, ecx, edx;
+		if (!__get_cpuid(1, & eax, & ebx, & ecx, & edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+			return false;
+		return __get_cpuid_count(7, 0, & eax, & ebx, & ecx, & edx) && (ebx & bit_SHA);
+	}
+	static bool cpuHasAvx2(void)
+	{
+		unsigned eax, ebx, ecx, edx;
+		/* Also make sure that the operating system saves the AVX register state. */
+		if (!__get_cpuid(1, & eax, & ebx, & ecx, & edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+			return false;
+		unsigned xcr0_low, xcr0_high;
+		__asm__ ("xgetbv" : "=a" (xcr0_low), "=d" (xcr0_high) : "c" (0));
+		if ((xcr0_low & 6) != 6)
+			return false;
+		return __get_cpuid_count(7, 0, & eax, & ebx, & ecx, & edx) && (ebx & bit_AVX2);
+	}
+#endif /* SHA1_X86_KERNELS */
+
+#ifdef SHA1_ARMV8_KERNEL
+	__attribute__((target("+crypto")))
+	static void compressArmV8(uint32_t state[5], const uchar * blocks, size_t block_count)
+	{
+		uint32x4_t abcd = vld1q_u32(state);
+		uint32_t e0 = state[4];
+		const uint32x4_t k[4] = { vdupq_n_u32(0x5a827999), vdupq_n_u32(0x6ed9eba1), vdupq_n_u32(0x8f1bbcdc), vdupq_n_u32(0xca62c1d6) };
+
+		for (; block_count --; blocks += BLOCK_SIZE)
+		{
+			const uint32x4_t abcd_saved = abcd;
+			const uint32_t e0_saved = e0;
+			uint32x4_t m[4];
+			for (int i = 0; i < 4; i ++)
+				m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * i)));
+
+			uint32_t e1 = 0;
+			for (int g = 0; g < 20; g ++)
+			{
+				/* Four rounds per step, the message schedule is computed in place in m[0..3]. */
+				const uint32x4_t wk = vaddq_u32(m[g & 3], k[g / 5]);
+				const uint32_t e = (g & 1) ? e1 : e0;
+				(g & 1 ? e0 : e1) = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+				if (g < 5)
+					abcd = vsha1cq_u32(abcd, e, wk);
+				else if (g < 10 || g >= 15)
+					abcd = vsha1pq_u32(abcd, e, wk);
+				else
+					abcd = vsha1mq_u32(abcd, e, wk);
+				if (g < 16)
+					m[g & 3] = vsha1su1q_u32(vsha1su0q_u32(m[g & 3], m[(g + 1) & 3], m[(g + 2) & 3]), m[(g + 3) & 3]);
+			}
+
+			e0 += e0_saved;
+			abcd = vaddq_u32(abcd, abcd_saved);
+		}
+		vst1q_u32(state, abcd);
+		state[4] = e0;
+	}
+
+	static bool cpuHasArmV8Crypto(void)
+	{
+#if defined(Q_OS_LINUX)
+		return getauxval(AT_HWCAP) & HWCAP_SHA1;
+#elif defined(__APPLE__)
+		return true;
+#else
+		return false;
+#endif
+	}
+#endif /* SHA1_ARMV8_KERNEL */
+
+	static std::vector<Kernel> availableKernels(void)
+	{
+		std::vector<Kernel> kernels { { "qt", 0, 0 }, { "generic", compressGeneric, 0 } };
+#ifdef SHA1_X86_KERNELS
+		if (cpuHasShaNi())
+			kernels.push_back(Kernel { "shani", compressShaNi, 0 });
+		if (cpuHasAvx2())
+			kernels.push_back(Kernel { "avx2", cpuHasShaNi() ? compressShaNi : compressGeneric, compressAvx2MultiBuffer });
+#endif
+#ifdef SHA1_ARMV8_KERNEL
+		if (cpuHasArmV8Crypto())
+			kernels.push_back(Kernel { "armv8", compressArmV8, 0 });
+#endif
+		return kernels;
+	}
+
+	static Kernel & selectedKernel(void) { static Kernel kernel { "qt", 0, 0 }; return kernel; }
+
+	/* Incremental hashing of a message, with the specified compression function. */
+	class Hasher
+	{
+	private:
+		const CompressFunction compress;
+		uint32_t state[5];
+		uchar block[BLOCK_SIZE];
+		size_t block_fill = 0;
+		uint64_t length;
+	public:
+		Hasher(CompressFunction compress, const uint32_t initial_state[5] = 0, uint64_t length = 0) : compress(compress), length(length)
+		{
+			static const uint32_t iv[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+			memcpy(state, initial_state ? initial_state : iv, sizeof state);
+		}
+		void addData(QByteArrayView data)
+		{
+			const uchar * p = reinterpret_cast<const uchar *>(data.data());
+			size_t n = data.size();
+			length += n;
+			if (block_fill)
+			{
+				const size_t x = std::min(n, BLOCK_SIZE - block_fill);
+				memcpy(block + block_fill, p, x);
+				block_fill += x, p += x, n -= x;
+				if (block_fill < BLOCK_SIZE)
+					return;
+				compress(state, block, 1);
+				block_fill = 0;
+			}
+			/* Whole blocks are hashed in place. */
+			if (n >= BLOCK_SIZE)
+			{
+				compress(state, p, n / BLOCK_SIZE);
+				p += n & ~(size_t) (BLOCK_SIZE - 1);
+				n %= BLOCK_SIZE;
+			}
+			memcpy(block, p, n);
+			block_fill = n;
+		}
+		QByteArray result(void)
+		{
+			const uint64_t bit_length = length * 8;
+			block[block_fill ++] = 0x80;
+			if (block_fill > BLOCK_SIZE - 8)
+			{
+				memset(block + block_fill, 0, BLOCK_SIZE - block_fill);
+				compress(state, block, 1);
+				block_fill = 0;
+			}
+			memset(block + block_fill, 0, BLOCK_SIZE - 8 - block_fill);
+			for (int i = 0; i < 8; i ++)
+				block[BLOCK_SIZE - 1 - i] = bit_length >> (8 * i);
+			compress(state, block, 1);
+			QByteArray digest(DIGEST_SIZE, 0);
+			for (int i = 0; i < DIGEST_SIZE; i ++)
+				digest[i] = state[i / 4] >> (24 - 8 * (i % 4));
+			return digest;
+		}
+	};
+
+	/* Iterates over the 64 byte blocks of a segmented message. Runs of whole blocks inside a segment are returned
+	 * in place; blocks that straddle segments are assembled into a small scratch block. */
+	class BlockCursor
+	{
+	private:
+		const Segments & segments;
+		size_t segment = 0, offset = 0;
+		uint64_t remaining;
+		uchar scratch[BLOCK_SIZE];
+	public:
+		uint64_t consumed = 0;
+		BlockCursor(const Segments & segments) : segments(segments), remaining(0) { for (const auto & s : segments) remaining += s.size(); }
+		/* Returns the number of whole blocks available contiguously at the current position (possibly in the scratch block). */
+		size_t available(void)
+		{
+			if (remaining < BLOCK_SIZE)
+				return 0;
+			while (offset == (size_t) segments.at(segment).size())
+				segment ++, offset = 0;
+			size_t n = (segments.at(segment).size() - offset) / BLOCK_SIZE;
+			return n ? n : 1;
+		}
+		/* Must only be called after 'available()' has returned non-zero. */
+		const uchar * blocks(void)
+		{
+			const QByteArrayView & s = segments.at(segment);
+			if (s.size() - offset >= BLOCK_SIZE)
+				return reinterpret_cast<const uchar *>(s.data()) + offset;
+			/* Assemble a block, which spans several segments. */
+			size_t fill = 0, x = segment, o = offset;
+			while (fill < BLOCK_SIZE)
+			{
+				const size_t n = std::min((size_t) (segments.at(x).size() - o), (size_t) BLOCK_SIZE - fill);
+				memcpy(scratch + fill, segments.at(x).data() + o, n);
+				fill += n, o += n;
+				if (o == (size_t) segments.at(x).size())
+					x ++, o = 0;
+			}
+			return scratch;
+		}
+		void advance(size_t block_count)
+		{
+			uint64_t n = block_count * BLOCK_SIZE;
+			remaining -= n, consumed += n;
+			while (n)
+			{
+				const size_t x = std::min((uint64_t) (segments.at(segment).size() - offset), n);
+				offset += x, n -= x;
+				if (offset == (size_t) segments.at(segment).size() && n)
+					segment ++, offset = 0;
+			}
+		}
+		/* Feeds the rest of the message, which is shorter than a block, to a hasher. */
+		void finish(Hasher & hasher)
+		{
+			for (; segment < segments.size(); segment ++, offset = 0)
+				hasher.addData(segments.at(segment).mid(offset));
+		}
+	};
+
+	static QByteArray hash(const Kernel & kernel, const Segments & segments)
+	{
+		if (!kernel.compress)
+		{
+			QCryptographicHash hash(QCryptographicHash::Sha1);
+			for (const auto & s : segments)
+				hash.addData(s);
+			return hash.result();
+		}
+		Hasher hasher(kernel.compress);
+		for (const auto & s : segments)
+			hasher.addData(s);
+		return hasher.result();
+	}
+
+	static std::vector<QByteArray> hashMultiBuffer(const Kernel & kernel, const std::vector<const Segments *> & messages)
+	{
+		std::vector<QByteArray> digests;
+		if (!kernel.compress_multi_buffer || messages.size() < 2)
+		{
+			for (const auto & m : messages)
+				digests.push_back(hash(kernel, * m));
+			return digests;
+		}
+		for (size_t first = 0; first < messages.size(); first += MAX_LANES)
+		{
+			const size_t lane_count = std::min(messages.size() - first, (size_t) MAX_LANES);
+			std::vector<BlockCursor> cursors;
+			cursors.reserve(lane_count);
+			uint32_t state[5][MAX_LANES];
+			for (size_t lane = 0; lane < MAX_LANES; lane ++)
+			{
+				static const uint32_t iv[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+				for (int i = 0; i < 5; i ++)
+					state[i][lane] = iv[i];
+				if (lane < lane_count)
+					cursors.emplace_back(* messages.at(first + lane));
+			}
+			/* Hash whole blocks in all lanes at once, while every lane still has whole blocks left. Unused lanes
+			 * just repeat the data of the first lane. */
+			while (1)
+			{
+				size_t block_count = SIZE_MAX;
+				for (auto & cursor : cursors)
+					block_count = std::min(block_count, cursor.available());
+				if (!block_count)
+					break;
+				const uchar * lanes[MAX_LANES];
+				for (size_t lane = 0; lane < MAX_LANES; lane ++)
+					lanes[lane] = lane < lane_count ? cursors.at(lane).blocks() : lanes[0];
+				kernel.compress_multi_buffer(state, lanes, block_count);
+				for (auto & cursor : cursors)
+					cursor.advance(block_count);
+			}
+			/* Finish each lane separately. */
+			for (size_t lane = 0; lane < lane_count; lane ++)
+			{
+				uint32_t lane_state[5];
+				for (int i = 0; i < 5; i ++)
+					lane_state[i] = state[i][lane];
+				Hasher hasher(kernel.compress, lane_state, cursors.at(lane).consumed);
+				cursors.at(lane).finish(hasher);
+				digests.push_back(hasher.result());
+			}
+		}
+		return digests;
+	}
+
+public:
+	/* The names of the kernels, which are supported by the CPU that the program runs on. */
+	static QStringList kernelNames(void)
+	{
+		QStringList names;
+		for (const auto & k : availableKernels())
+			names << k.name;
+		return names;
+	}
+	/* Selects the kernel to use. 'auto' selects the fastest kernel, which is supported by the CPU.
+	 * This is not thread-safe, and must be called before any hashing is done. */
+	static bool selectKernel(const QString & name)
+	{
+		const std::vector<Kernel> kernels = availableKernels();
+		if (name == "auto")
+		{
+			/* Prefer the dedicated SHA1 instructions, then the multi-buffer kernel, then the reference. */
+			for (const char * preferred : { "shani", "armv8", "avx2", "qt" })
+				for (const auto & k : kernels)
+					if (k.name == QString(preferred))
+						return (selectedKernel() = k), true;
+		}
+		for (const auto & k : kernels)
+			if (k.name == name)
+				return (selectedKernel() = k), true;
+		return false;
+	}
+	static const char * kernelName(void) { return selectedKernel().name; }
+	/* True if the selected kernel benefits from hashing several pieces at once with 'hashMultiBuffer()'. */
+	static bool isMultiBuffer(void) { return selectedKernel().compress_multi_buffer; }
+
+	static QByteArray hash(const Segments & segments) { return hash(selectedKernel(), segments); }
+	static QByteArray hash(QByteArrayView data) { return hash(selectedKernel(), Segments { data }); }
+	/* Hashes several independent messages, with the multi-buffer kernel, if it is selected.
+	 * Returns the digests in the order of the messages. */
+	static std::vector<QByteArray> hashMultiBuffer(const std::vector<const Segments *> & messages) { return hashMultiBuffer(selectedKernel(), messages); }
+
+	/* Checks all kernels supported by the CPU against QCryptographicHash, with messages of many different
+	 * lengths, split into segments in many different ways, and hashed both one at a time and in multi-buffer batches. */
+	static bool selfTest(void)
+	{
+		std::mt19937 random(1);
+		std::vector<QByteArray> messages;
+		for (int length : { 0, 1, 3, 55, 56, 63, 64, 65, 119, 120, 127, 128, 129, 1000, 4095, 4096, 65537, 1 << 20 })
+		{
+			QByteArray m(length, 0);
+			for (auto & c : m)
+				c = random();
+			messages.push_back(m);
+		}
+		bool result = true;
+		for (const auto & kernel : availableKernels())
+		{
+			int failures = 0;
+			std::vector<Segments> segmented;
+			std::vector<QByteArray> expected;
+			for (const auto & m : messages)
+			{
+				expected.push_back(QCryptographicHash::hash(m, QCryptographicHash::Sha1));
+				/* Whole, and split at random points. */
+				Segments whole { QByteArrayView(m) }, split;
+				for (size_t offset = 0; offset < (size_t) m.length(); )
+				{
+					const size_t n = std::min((size_t) (random() % 200 + 1), (size_t) m.length() - offset);
+					split.push_back(QByteArrayView(m.constData() + offset, n));
+					offset += n;
+				}
+				failures += hash(kernel, whole) != expected.back();
+				failures += hash(kernel, split) != expected.back();
+				segmented.push_back(split);
+			}
+			std::vector<const Segments *> batch;
+			for (const auto & s : segmented)
+				batch.push_back(& s);
+			/* Batches of messages of different lengths, and of the same length. */
+			const std::vector<QByteArray> digests = hashMultiBuffer(kernel, batch);
+			for (size_t i = 0; i < digests.size(); i ++)
+				failures += digests.at(i) != expected.at(i);
+			std::vector<const Segments *> same_length(MAX_LANES - 1, & segmented.back());
+			for (const auto & d : hashMultiBuffer(kernel, same_length))
+				failures += d != expected.back();
+
+			qInfo().noquote() << QString("SHA1 kernel '%1': %2").arg(kernel.name).arg(failures ? "FAILED" : "OK");
+			result &= !failures;
+		}
+		return result;
+	}
+};
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDebug>
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/* A connection between the shard coordinator and a worker process, which exchange tab-separated text lines.
+ *
+ * Addresses are either 'unix:<path>', for a Unix domain socket - for worker processes on the same host, or
+ * '<host>:<port>' for a TCP socket - for worker processes on other hosts, which share the storage of the torrent data. */
+class ShardChannel
+{
+private:
+	int fd = -1;
+	QByteArray input;
+public:
+	ShardChannel(int fd = -1) : fd(fd) {}
+	ShardChannel(const ShardChannel &) = delete;
+	~ShardChannel() { close(); }
+
+	/* Prepares a new socket (e.g. of an accepted connection), or passes on -1: makes the socket close on exec, and,
+	 * where sends can not be flagged with MSG_NOSIGNAL (macOS, some BSDs), not raise SIGPIPE. */
+	static int prepared(int s)
+	{
+#ifdef Q_OS_UNIX
+		if (s != -1)
+		{
+			fcntl(s, F_SETFD, FD_CLOEXEC);
+#ifndef MSG_NOSIGNAL
+			const int one = 1;
+			setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, & one, sizeof one);
+#endif
+		}
+#endif
+		return s;
+	}
+	/* Opens a listening socket, or connects to a listening socket. Returns the socket, or -1 on error. */
+	static int open(const QString & address, bool listening)
+	{
+#ifdef Q_OS_UNIX
+		int s = -1;
+		if (address.startsWith("unix:"))
+		{
+			struct sockaddr_un a = {};
+			const QByteArray path = address.mid(5).toLocal8Bit();
+			if (path.isEmpty() || (size_t) path.size() >= sizeof a.sun_path || (s = prepared(socket(AF_UNIX, SOCK_STREAM, 0))) == -1)
+				return -1;
+			a.sun_family = AF_UNIX;
+			memcpy(a.sun_path, path.constData(), path.size());
+			/* Remove the socket of a previous coordinator. */
+			if (listening)
+				unlink(path.constData());
+			if (listening ? bind(s, (struct sockaddr *) & a, sizeof a) || listen(s, SOMAXCONN) : ::connect(s, (struct sockaddr *) & a, sizeof a))
+			{
+				::close(s);
+				return -1;
+			}
+			return s;
+		}
+		const int colon = address.lastIndexOf(':');
+		if (colon == -1)
+			return -1;
+		const QByteArray host = address.left(colon).toLocal8Bit(), port = address.mid(colon + 1).toLocal8Bit();
+		struct addrinfo hints = {}, * addresses;
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = listening ? AI_PASSIVE : 0;
+		if (getaddrinfo(host.isEmpty() ? 0 : host.constData(), port.constData(), & hints, & addresses))
+			return -1;
+		for (struct addrinfo * a = addresses; a && s == -1; a = a->ai_next)
+		{
+			if ((s = prepared(socket(a->ai_family, a->ai_socktype, a->ai_protocol))) == -1)
+				continue;
+			const int reuse = 1;
+			if (listening)
+				setsockopt(s, SOL_SOCKET, SO_REUSEADDR, & reuse, sizeof reuse);
+			if (listening ? bind(s, a->ai_addr, a->ai_addrlen) || listen(s, SOMAXCONN) : ::connect(s, a->ai_addr, a->ai_addrlen))
+			{
+				::close(s);
+				s = -1;
+			}
+		}
+		freeaddrinfo(addresses);
+		return s;
+#else
+		Q_UNUSED(address)
+		Q_UNUSED(listening)
+		return -1;
+#endif
+	}
+	bool connect(const QString & address) { return (fd = open(address, false)) != -1; }
+	int handle(void) const { return fd; }
+	void close(void)
+	{
+#ifdef Q_OS_UNIX
+		if (fd != -1)
+			::close(fd);
+#endif
+		fd = -1;
+	}
+
+	bool send(const QStringList & fields)
+	{
+#ifdef Q_OS_UNIX
+#ifdef MSG_NOSIGNAL
+		const int flags = MSG_NOSIGNAL;
+#else
+		const int flags = 0;
+#endif
+		const QByteArray line = (fields.join('\t') + '\n').toUtf8();
+		for (qsizetype x = 0, written; x < line.size(); x += written)
+			if ((written = ::send(fd, line.constData() + x, line.size() - x, flags)) <= 0)
+				return false;
+		return true;
+#else
+		Q_UNUSED(fields)
+		return false;
+#endif
+	}
+	/* Reads the data available, waiting for it if there is none. Returns false if the connection has been closed. */
+	bool receive(void)
+	{
+#ifdef Q_OS_UNIX
+		char buffer[4096];
+		const ssize_t length = ::recv(fd, buffer, sizeof buffer, 0);
+		if (length <= 0)
+			return false;
+		input.append(buffer, length);
+		return true;
+#else
+		return false;
+#endif
+	}
+	/* Takes the next complete line received. Returns false if there is none. */
+	bool takeLine(QStringList & fields)
+	{
+		const qsizetype end = input.indexOf('\n');
+		if (end == -1)
+			return false;
+		fields = QString::fromUtf8(input.left(end)).split('\t');
+		input.remove(0, end + 1);
+		return true;
+	}
+	/* Waits for the next line. Returns false if the connection has been closed. */
+	bool readLine(QStringList & fields)
+	{
+		while (!takeLine(fields))
+			if (!receive())
+				return false;
+		return true;
+	}
+};
+
+/* Distributes the verification of a list of torrents over several worker processes, for torrent archives that are
+ * too large to be verified by a single host in time.
+ *
+ * The torrents are split into shards - large torrents into ranges of 'shard_pieces' pieces, other torrents as a whole -
+ * which are handed out to the workers one at a time, as the workers complete them, so that faster workers take
+ * more shards. Each worker records the results of its shards in a partial result file (see 'PartialResults'), which
+ * are merged into the results of the whole run, once all shards have been completed. The shard of a worker, which
+ * disconnects before completing it, is handed out again.
+ *
+ * The protocol consists of tab-separated lines:
+ *
+ *	hello	<torrent count>	<partial result file>			- worker, when it connects
+ *	next	[<shard id>]						- worker, requests a shard, after completing the previous one
+ *	shard	<shard id>	<torrent index>	<first piece>	<last piece>	<shard count>	<torrent file>
+ *									- coordinator, the next shard to verify
+ *	done								- coordinator, all shards have been completed
+ *	error	<message>						- coordinator, the worker is not accepted
+ *
+ * A shard completes, when the worker has recorded its results and requests the next shard. */
+class ShardCoordinator
+{
+public:
+	enum
+	{
+		DEFAULT_SHARD_PIECES	= 4096,
+	};
+	struct Shard
+	{
+		int torrent_index = -1;
+		/* The range of pieces to verify; 'last_piece' -1 - the whole torrent. */
+		int64_t first_piece = 0, last_piece = -1;
+		/* The number of shards of the torrent. */
+		int shard_count = 1;
+	};
+private:
+	const QStringList torrent_files;
+	const std::vector<Shard> shards;
+	int listener = -1;
+	QStringList partial_result_files;
+public:
+	/* Splits torrents into shards. Torrents with a piece count of 0 - which can not be verified piece by piece -
+	 * are not split. */
+	static std::vector<Shard> split(const std::vector<int64_t> & piece_counts, int64_t shard_pieces)
+	{
+		std::vector<Shard> shards;
+		for (int i = 0; i < (int) piece_counts.size(); i ++)
+		{
+			const int64_t piece_count = piece_counts.at(i);
+			if (piece_count <= shard_pieces)
+			{
+				shards.push_back(Shard { i, 0, -1, 1 });
+				continue;
+			}
+			const int shard_count = (piece_count + shard_pieces - 1) / shard_pieces;
+			for (int64_t first_piece = 0; first_piece < piece_count; first_piece += shard_pieces)
+				shards.push_back(Shard { i, first_piece, std::min(first_piece + shard_pieces, piece_count) - 1, shard_count });
+		}
+		return shards;
+	}
+
+	ShardCoordinator(const QStringList & torrent_files, const std::vector<Shard> & shards) : torrent_files(torrent_files), shards(shards) {}
+	~ShardCoordinator()
+	{
+#ifdef Q_OS_UNIX
+		if (listener != -1)
+			::close(listener);
+#endif
+	}
+	size_t shardCount(void) const { return shards.size(); }
+
+	bool listen(const QString & address)
+	{
+		if ((listener = ShardChannel::open(address, true)) == -1)
+			qCritical().noquote() << "Can not listen for worker processes at:" << address;
+		return listener != -1;
+	}
+	/* Hands out all shards, and waits until they have been completed. */
+	bool run(void)
+	{
+#ifdef Q_OS_UNIX
+		std::deque<size_t> pending;
+		for (size_t i = 0; i < shards.size(); i ++)
+			pending.push_back(i);
+		size_t completed_count = 0;
+		struct Worker
+		{
+			ShardChannel channel;
+			QString partial_result_file;
+			/* The shard being verified by the worker, -1 - none. */
+			int shard = -1;
+			bool waiting = false;
+			Worker(int fd) : channel(fd) {}
+		};
+		std::list<Worker> workers;
+		while (completed_count < shards.size() || workers.size())
+		{
+			std::vector<struct pollfd> fds(1, pollfd { listener, POLLIN, 0 });
+			for (const auto & w : workers)
+				fds.push_back(pollfd { w.channel.handle(), POLLIN, 0 });
+			if (poll(fds.data(), fds.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				qCritical() << "Can not wait for worker processes.";
+				return false;
+			}
+			if (fds.at(0).revents & POLLIN)
+			{
+				const int s = ShardChannel::prepared(accept(listener, 0, 0));
+				if (s != -1)
+					workers.emplace_back(s);
+			}
+			/* Drops a worker - the shard of a worker, which has gone away, is handed out again first. */
+			auto drop = [&] (std::list<Worker>::iterator w) -> std::list<Worker>::iterator {
+				if (w->shard != -1)
+				{
+					qInfo().noquote() << "Worker disconnected, handing out its shard again:" << w->partial_result_file;
+					pending.push_front(w->shard);
+				}
+				return workers.erase(w);
+			};
+			size_t n = 1;
+			for (auto w = workers.begin(); w != workers.end(); n ++)
+			{
+				bool connected = true;
+				if (n < fds.size() && fds.at(n).revents)
+				{
+					connected = w->channel.receive();
+					QStringList fields;
+					while (connected && w->channel.takeLine(fields))
+						if (fields.at(0) == "hello" && fields.length() == 3)
+						{
+							if (fields.at(1).toInt() != torrent_files.length())
+							{
+								w->channel.send(QStringList() << "error" << "the torrent list of the worker does not match the torrent list of the coordinator");
+								connected = false;
+							}
+							else if (!partial_result_files.contains(w->partial_result_file = fields.at(2)))
+								partial_result_files << fields.at(2);
+						}
+						else if (fields.at(0) == "next" && w->partial_result_file.length())
+						{
+							if (fields.length() == 2 && w->shard != -1 && fields.at(1).toInt() == w->shard)
+							{
+								const Shard & s = shards.at(w->shard);
+								completed_count ++;
+								qInfo().noquote() << QString("Completed shard %1 of %2 (%3, %4), worker: %5")
+										     .arg(completed_count).arg(shards.size()).arg(torrent_files.at(s.torrent_index))
+										     .arg(s.last_piece == -1 ? QString("all pieces") : QString("pieces %1-%2").arg(s.first_piece).arg(s.last_piece))
+										     .arg(w->partial_result_file);
+								w->shard = -1;
+							}
+							w->waiting = true;
+						}
+						else
+							connected = false;
+				}
+				w = connected ? std::next(w) : drop(w);
+			}
+			/* Hand out shards to the waiting workers. Repeat if a worker has gone away meanwhile, as its shard
+			 * is to be handed out again. */
+			for (bool dropped = true; dropped; )
+			{
+				dropped = false;
+				for (auto w = workers.begin(); w != workers.end(); )
+				{
+					bool connected = true;
+					if (w->waiting && pending.size())
+					{
+						const Shard & s = shards.at(w->shard = pending.front());
+						pending.pop_front();
+						w->waiting = false;
+						connected = w->channel.send(QStringList() << "shard" << QString::number(w->shard) << QString::number(s.torrent_index)
+									    << QString::number(s.first_piece) << QString::number(s.last_piece) << QString::number(s.shard_count)
+									    << torrent_files.at(s.torrent_index));
+					}
+					else if (w->waiting && completed_count == shards.size())
+					{
+						w->channel.send(QStringList() << "done");
+						connected = false;
+					}
+					dropped |= !connected && w->shard != -1;
+					w = connected ? std::next(w) : drop(w);
+				}
+			}
+		}
+		return true;
+#else
+		qCritical() << "Sharded verification is only supported on Unix systems.";
+		return false;
+#endif
+	}
+	/* The partial result files of the workers, as reported by the workers. */
+	const QStringList & partialResultFiles(void) const { return partial_result_files; }
+};
+
+/* The worker side of sharded verification (see 'ShardCoordinator'). */
+class ShardWorker
+{
+private:
+	ShardChannel channel;
+	const QStringList torrent_files;
+public:
+	ShardWorker(const QStringList & torrent_files) : torrent_files(torrent_files) {}
+
+	bool connect(const QString & address, const QString & partial_result_file)
+	{
+		if (!channel.connect(address) || !channel.send(QStringList() << "hello" << QString::number(torrent_files.length()) << partial_result_file))
+		{
+			qCritical().noquote() << "Can not connect to the shard coordinator at:" << address;
+			return false;
+		}
+		return true;
+	}
+	/* Reports the completion of a shard ('completed_shard' -1 - none), and takes the next shard to verify.
+	 * 'shard_id' is set to -1, if all shards have been completed. */
+	bool next(int completed_shard, int & shard_id, ShardCoordinator::Shard & shard)
+	{
+		QStringList fields;
+		if (!channel.send(completed_shard == -1 ? QStringList() << "next" : QStringList() << "next" << QString::number(completed_shard))
+				|| !channel.readLine(fields))
+		{
+			qCritical() << "The connection to the shard coordinator has been lost.";
+			return false;
+		}
+		if (fields.at(0) == "done")
+		{
+			shard_id = -1;
+			return true;
+		}
+		if (fields.at(0) == "shard" && fields.length() == 7)
+		{
+			shard_id = fields.at(1).toInt();
+			shard.torrent_index = fields.at(2).toInt();
+			shard.first_piece = fields.at(3).toLongLong();
+			shard.last_piece = fields.at(4).toLongLong();
+			shard.shard_count = fields.at(5).toInt();
+			if (shard.torrent_index >= 0 && shard.torrent_index < torrent_files.length() && torrent_files.at(shard.torrent_index) == fields.at(6))
+				return true;
+			qCritical() << "The torrent list of the worker does not match the torrent list of the coordinator.";
+			return false;
+		}
+		qCritical().noquote() << "The shard coordinator has not accepted the worker:" << fields.mid(1).join(' ');
+		return false;
+	}
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <QStringList>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BitTorrent.hxx"
+#include "MetadataCatalog.hxx"
+
+/* The in-memory catalog of the torrents being verified. The torrent files are loaded once, by a pool of loader threads,
+ * roughly in list order, and the catalog is shared by the statistics reporting and the verification of the torrents.
+ * Consumers do not have to wait for the whole list to be loaded - 'wait()' returns a torrent as soon as it has been loaded,
+ * so verification can start right after the first torrent is ready, while the rest of the list is still being loaded.
+ * If a metadata catalog is specified, torrents which are in the catalog, and have not changed since, are loaded from the catalog. */
+class TorrentCatalog
+{
+public:
+	struct Statistics
+	{
+		/* The number of torrents loaded so far; the totals below cover the loaded torrents only. */
+		int torrent_count = 0;
+		/* The number of torrents loaded from the metadata catalog. */
+		int cataloged_count = 0;
+		unsigned file_count = 0;
+		uint64_t total_data_length = 0;
+		/* True when all torrents in the list have been loaded (or have failed to load). */
+		bool complete = false;
+	};
+private:
+	enum State : uint8_t { PENDING, LOADED, FAILED };
+	const QStringList torrent_files;
+	const std::shared_ptr<const MetadataCatalog> metadata_catalog;
+	std::vector<std::shared_ptr<const BitTorrent>> torrents;
+	std::vector<State> states;
+	std::atomic<int> next_index { 0 };
+	std::mutex mutex;
+	std::condition_variable torrent_loaded;
+	Statistics statistics_so_far;
+	int finished_count = 0;
+	bool cancelled = false;
+	std::vector<std::thread> loaders;
+
+	void loader(void)
+	{
+		int i;
+		while ((i = next_index ++) < torrent_files.length())
+		{
+			const int record = metadata_catalog ? metadata_catalog->find(torrent_files.at(i)) : -1;
+			const bool cataloged = record != -1 && metadata_catalog->isCurrent(record);
+			std::shared_ptr<BitTorrent> t = cataloged ? metadata_catalog->torrent(record) : std::make_shared<BitTorrent>(torrent_files.at(i));
+			const bool ok = cataloged || t->parse();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cancelled)
+				return;
+			if (ok)
+			{
+				torrents.at(i) = t;
+				statistics_so_far.torrent_count ++;
+				statistics_so_far.cataloged_count += cataloged;
+				if (!t->torrent_details.files.length())
+				{
+					statistics_so_far.total_data_length += t->torrent_details.length;
+					statistics_so_far.file_count ++;
+				}
+				else
+				{
+					/* Padding files of hybrid torrents hold no data. */
+					for (const auto & file : t->torrent_details.files)
+						if (!file.padding)
+						{
+							statistics_so_far.total_data_length += file.length;
+							statistics_so_far.file_count ++;
+						}
+				}
+			}
+			states.at(i) = ok ? LOADED : FAILED;
+			statistics_so_far.complete = ++ finished_count == torrent_files.length();
+			torrent_loaded.notify_all();
+		}
+	}
+public:
+	/* Starts loading the torrent files in the background, with 'thread_count' threads (0 - one per processor core). */
+	TorrentCatalog(const QStringList & torrent_files, unsigned thread_count, std::shared_ptr<const MetadataCatalog> metadata_catalog = 0)
+		: torrent_files(torrent_files), metadata_catalog(metadata_catalog), torrents(torrent_files.length()), states(torrent_files.length(), PENDING)
+	{
+		statistics_so_far.complete = !torrent_files.length();
+		if (!thread_count)
+			thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+		thread_count = std::min(thread_count, (unsigned) std::max<qsizetype>(torrent_files.length(), 1));
+		for (unsigned i = 0; i < thread_count; i ++)
+			loaders.emplace_back(& TorrentCatalog::loader, this);
+	}
+	~TorrentCatalog()
+	{
+		cancel();
+		for (auto & l : loaders)
+			l.join();
+	}
+
+	int count(void) const { return torrent_files.length(); }
+	const QString & fileName(int index) const { return torrent_files.at(index); }
+
+	/* Blocks until the torrent with the specified index has been loaded. Returns null if the torrent file
+	 * could not be loaded, or if the catalog has been cancelled. */
+	std::shared_ptr<const BitTorrent> wait(int index)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		torrent_loaded.wait(lock, [&] { return states.at(index) != PENDING || cancelled; });
+		return torrents.at(index);
+	}
+	Statistics statistics(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return statistics_so_far;
+	}
+	/* Stop loading torrents, and wake up all waiters. */
+	void cancel(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+		next_index = torrent_files.length();
+		torrent_loaded.notify_all();
+	}
+};
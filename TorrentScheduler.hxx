@@ -0,0 +1,125 @@
+#pragma once
+
+#include <QString>
+#include <QFileInfo>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+/* Schedules the verification of many torrents concurrently, while limiting the number of
+ * concurrently verified torrents on each physical storage device. Jobs are grouped by the
+ * device (st_dev) that holds the torrent data, and each device gets its own pool of worker threads,
+ * so that adding more disks scales, but a single spinning disk is not thrashed by many
+ * concurrent sequential readers.
+ *
+ * Jobs are identified by their index in the list of torrents being verified. Jobs for the same device are
+ * started in the order they are submitted, and the caller collects the results, in list order, with 'wait()'. */
+class TorrentScheduler
+{
+private:
+	struct Job
+	{
+		int index;
+		std::function<void(void)> work;
+	};
+	struct Device
+	{
+		std::deque<Job> pending;
+		std::vector<std::thread> workers;
+	};
+	const unsigned jobs_per_device;
+	std::mutex mutex;
+	std::condition_variable job_available, job_done;
+	std::map<uint64_t, Device> devices;
+	std::vector<bool> done;
+	bool cancelled = false, shutting_down = false;
+
+	void worker(Device & device)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (1)
+		{
+			job_available.wait(lock, [&] { return device.pending.size() || shutting_down; });
+			if (!device.pending.size())
+				return;
+			Job job = std::move(device.pending.front());
+			device.pending.pop_front();
+			if (!cancelled)
+			{
+				lock.unlock();
+				job.work();
+				lock.lock();
+			}
+			done.at(job.index) = true;
+			job_done.notify_all();
+		}
+	}
+public:
+	TorrentScheduler(unsigned jobs_per_device, int job_count) : jobs_per_device(jobs_per_device ? jobs_per_device : 1), done(job_count, false) {}
+	~TorrentScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = shutting_down = true;
+			job_available.notify_all();
+		}
+		for (auto & device : devices)
+			for (auto & w : device.second.workers)
+				w.join();
+	}
+
+	/* Returns an identifier of the storage device that holds 'path', or of its nearest existing parent directory. */
+	static uint64_t deviceId(QString path)
+	{
+#ifdef Q_OS_UNIX
+		struct stat st;
+		while (path.length())
+		{
+			if (!stat(path.toLocal8Bit().constData(), & st))
+				return st.st_dev;
+			int i = path.lastIndexOf('/');
+			if (i <= 0)
+				break;
+			path.truncate(i);
+		}
+#else
+		Q_UNUSED(path)
+#endif
+		return 0;
+	}
+
+	void submit(int index, uint64_t device_id, const std::function<void(void)> & work)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Device & device = devices[device_id];
+		device.pending.push_back(Job { index, work });
+		/* Start the worker threads for a device when the device is first seen. */
+		while (device.workers.size() < jobs_per_device)
+			device.workers.emplace_back(& TorrentScheduler::worker, this, std::ref(device));
+		job_available.notify_all();
+	}
+
+	/* Blocks until the job with the specified index has completed (or has been skipped after a 'cancel()'). */
+	void wait(int index)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job_done.wait(lock, [&] { return (bool) done.at(index); });
+	}
+
+	/* Do not start any more jobs. Jobs already running are allowed to complete - the caller stops them, if needed
+	 * (see 'VerificationOptions::cancelled'), before the scheduler is destroyed. */
+	void cancel(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+	}
+};
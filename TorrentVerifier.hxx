@@ -0,0 +1,1025 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "BitTorrent.hxx"
+#include "CheckpointJournal.hxx"
+#include "FileSizeScanner.hxx"
+#include "Metrics.hxx"
+#include "PieceHashPipeline.hxx"
+#include "PieceReader.hxx"
+#include "PieceSampler.hxx"
+#include "ReadEngine.hxx"
+#include "ReadThrottle.hxx"
+#include "ResultStream.hxx"
+#include "Sha1.hxx"
+#include "TorrentScheduler.hxx"
+#include "VerificationCache.hxx"
+
+enum
+{
+	MD5_HASH_STRING_LENGTH	= 32,
+};
+
+struct TorrentCheckResult
+{
+	QString		torrent_filename;
+	/* If any corrupted pieces are found in the torrent, when SHA1 checksums of data pieces in the torrent is performed,
+	 * this list will hold all affected files. */
+	QStringList	corrupted_files_by_sha1_checksum;
+	/* The same, for the SHA-256 Merkle tree hashes of v2 torrents. */
+	QStringList	corrupted_files_by_sha256_checksum;
+	/* If MD5 checksumming of data for files which names *look* like an MD5 hash value is performed,
+	 * this list will hold any files that have been found to be corrupted when checking the MD5 hashes. */
+	QStringList	corrupted_files_by_md5_checksum;
+	/* The amount of data hashed, and the time taken to verify the torrent. */
+	uint64_t	hashed_length = 0;
+	uint64_t	elapsed_ms = 0;
+	/* The time that the reads of the torrent data have waited to be issued, if reads are throttled (see 'ReadThrottle'),
+	 * summed over all reads - reads which wait at the same time are all counted. */
+	uint64_t	throttled_ms = 0;
+	/* When only a sample of the pieces is verified - the number of pieces in the torrent, and in the sample,
+	 * and the number of corrupted pieces found in the sample. */
+	int64_t		piece_count = 0;
+	int64_t		sampled_pieces = 0;
+	int64_t		corrupted_sampled_pieces = 0;
+
+	TorrentCheckResult(const QString & torrent_filename) : torrent_filename(torrent_filename){}
+};
+
+struct VerificationOptions
+{
+	bool		verbose = false;
+	bool		check_size_only = false;
+	bool		compute_md5_hashes = false;
+	/* The number of SHA1 hashing worker threads. If zero, the data is hashed in the data reading thread. */
+	unsigned	hash_thread_count = 0;
+	/* Memory-map the data files, instead of reading them into piece buffers. */
+	bool		memory_map_files = false;
+	/* The data reading backend, see 'ReadEngine::engineNames()'. */
+	QString		io_engine = "sync";
+	/* The maximum number of reads in flight, for the asynchronous read engines. */
+	unsigned	io_queue_depth = 4;
+	/* Read the data with direct (O_DIRECT) reads, bypassing the page cache, whenever possible. */
+	bool		direct_io = false;
+	/* Drop the data read from the page cache, once it has been read. */
+	bool		drop_cache = false;
+	/* If set, pieces that have been verified by a previous run, and only span files that have not changed since,
+	 * are not hashed again. The cache is updated after each complete verification of a torrent. */
+	const VerificationCache * cache = 0;
+	/* Hash all pieces, regardless of the cache contents (the cache is still updated). */
+	bool		full_verification = false;
+	/* If set, corrupted pieces are also written to this machine-readable results stream. */
+	ResultStream *	results = 0;
+	/* The hashes to verify the torrents with: 0 - the v2 (SHA-256 Merkle tree) hashes, if the torrent has them,
+	 * and the v1 (SHA1) hashes otherwise; 1 - only the v1 hashes; 2 - only the v2 hashes. */
+	int		hash_version = 0;
+	/* If set, only these pieces, in piece order, are verified - e.g. the pieces of data files which have changed.
+	 * As with sampling, the verification cache does not apply to the selected pieces, and no checkpoints are made.
+	 * The pieces are v1 pieces, see 'selectsV1Pieces()' - torrents with only v2 hashes are always verified as a whole. */
+	const std::vector<int64_t> * piece_selection = 0;
+	/* If set, the results of a bulk scan of the data files of all torrents, which are used instead of checking
+	 * the files of each torrent one at a time. */
+	const FileSizeScanner * size_scan = 0;
+	/* If either is set, only verify a random sample of the pieces of each torrent - a fraction of the pieces,
+	 * or a number of pieces per torrent, see 'PieceSampler'. */
+	double		sample_fraction = 0;
+	int64_t		sample_count = 0;
+	uint64_t	sample_seed = 0;
+	/* If set, verification stops as soon as the flag is set - e.g. when processing of the torrent list is aborted,
+	 * while torrents are being verified in the background. A cancelled verification fails. */
+	const std::atomic<bool> * cancelled = 0;
+};
+
+/* If the filename *looks* like an md5 hash value (after removing any file extensions), returns that hash value,
+ * otherwise returns an empty string. */
+inline QString md5HashFromFilename(const QString & fileName)
+{
+	QString md5Hash = QFileInfo(fileName).fileName().split('.').at(0);
+	if (md5Hash.length() != MD5_HASH_STRING_LENGTH)
+		return QString();
+	for (const auto & c : md5Hash)
+		if (		   !('0' <= c && c <= '9')
+				&& !('a' <= c && c <= 'f')
+				&& !('A' <= c && c <= 'F')
+				)
+			return QString();
+	return md5Hash;
+}
+
+/* A data file of a torrent. */
+struct TorrentDataFile
+{
+	QString		name;
+	uint64_t	size;
+	/* The MD5 hash from the 'md5sum' key of the file, or empty. */
+	QString		md5sum;
+	/* A padding file of a hybrid torrent, which is not stored - its data is all zeros. */
+	bool		padding;
+};
+
+/* Returns the data files of a torrent, in torrent order. */
+inline QList<TorrentDataFile> torrentDataFiles(const QString & torrentDataDirectoryName, const BitTorrent & bitTorrent)
+{
+	QList<TorrentDataFile> dataFiles;
+	if (!bitTorrent.torrent_details.files.length())
+		/* Single-file torrent. */
+		dataFiles << TorrentDataFile { torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name, (uint64_t) bitTorrent.torrent_details.length,
+				bitTorrent.torrent_details.md5sum, false };
+	else
+	{
+		/* Multiple files in torrent. */
+		for (const auto & f : bitTorrent.torrent_details.files)
+		{
+			QString t(torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name);
+			for (const auto & f : f.path)
+				t += '/' + f;
+			dataFiles << TorrentDataFile { t, (uint64_t) f.length, f.md5sum, f.padding };
+		}
+	}
+	return dataFiles;
+}
+
+/* If MD5 checking is requested, returns the expected MD5 hashes of a file - from the 'md5sum' key in the torrent,
+ * and from the file name, if it *looks* like an MD5 hash value. */
+inline QStringList expectedMd5Hashes(const TorrentDataFile & dataFile, const VerificationOptions & options)
+{
+	QStringList hashes;
+	if (!options.compute_md5_hashes || dataFile.padding)
+		return hashes;
+	if (dataFile.md5sum.length())
+		hashes << dataFile.md5sum;
+	const QString md5Hash = md5HashFromFilename(dataFile.name).toLower();
+	if (md5Hash.length() && !hashes.contains(md5Hash))
+		hashes << md5Hash;
+	return hashes;
+}
+
+/* Returns true if the pieces of a torrent can be verified selectively, as v1 pieces - i.e. unless the torrent is only
+ * verified with its v2 hashes. Hybrid torrents are verified with their v1 hashes, when only some pieces are verified. */
+inline bool selectsV1Pieces(const BitTorrent & bitTorrent, const VerificationOptions & options)
+{
+	return bitTorrent.hasV1Hashes() && options.hash_version != 2;
+}
+
+/* Returns the note on the throttled time, for the verification speed report, or an empty string if reads are not throttled. */
+inline QString throttledTimeNote(uint64_t throttled_ms)
+{
+	if (!ReadThrottle::instance().isActive())
+		return QString();
+	return QString(", throttled for %1 seconds").arg(throttled_ms / 1000., 0, 'f', 2);
+}
+
+/* Verifies the data of a v2 (BEP 52) torrent, or of a hybrid torrent, against the SHA-256 Merkle trees of its files.
+ * The pieces of v2 torrents never span files, so the files are verified independently of each other, with one file
+ * per hashing thread. Each piece is checked against the piece layer of its file, which is first checked against the
+ * 'pieces root' of the file; files of a single piece are checked against the 'pieces root' directly.
+ * The existence and the sizes of the files must have been checked already.
+ *
+ * For the verification cache and the checkpoints, the pieces of all files are numbered in file order, as the v1 pieces
+ * are numbered across the torrent data. The files are reported in file order, and checkpoints are made at file
+ * boundaries only, so verification resumes at the start of the file that was being verified. */
+inline bool verify_torrent_v2_data(const QString & torrentDataDirectoryName, const BitTorrent & bitTorrent,
+		const QList<TorrentDataFile> & dataFiles, const VerificationOptions & options, struct TorrentCheckResult & checkResult,
+		int64_t resume_piece, const std::function<void(int64_t next_piece)> & checkpoint)
+{
+	QElapsedTimer timer;
+	timer.start();
+	const uint64_t piece_length = bitTorrent.torrent_details.piece_length;
+	const uint64_t blocks_per_piece = piece_length / MerkleTree::LEAF_SIZE;
+	const QList<BitTorrent::TorrentDetails::v2_file_info> & v2Files = bitTorrent.torrent_details.v2_files;
+	if (options.sample_fraction || options.sample_count)
+		qInfo() << "Sampling is not supported for v2 torrents, verifying all pieces.";
+
+	Metrics & metrics = Metrics::instance();
+	std::atomic<uint64_t> & deviceBytes = metrics.deviceBytes(TorrentScheduler::deviceId(torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name));
+	ReadThrottle & throttle = ReadThrottle::instance();
+	std::atomic<uint64_t> throttled_ns { 0 };
+
+	struct FileResult
+	{
+		QString name;
+		QStringList md5Hashes;
+		/* The pieces of the file to hash, counted from the start of the file. */
+		std::vector<int64_t> pieces;
+		/* Set if the file could not be verified at all. */
+		QString error;
+		std::vector<int64_t> corrupted_pieces;
+		QByteArray md5;
+		uint64_t hashed_length = 0;
+		/* Set when the file has been verified, and can be reported. */
+		bool done = false;
+	};
+	std::vector<FileResult> fileResults(v2Files.length());
+	/* The number of the first piece of each file, and the total number of pieces. */
+	std::vector<int64_t> firstPieces(1, 0);
+	std::unordered_map<std::string, int> dataFileIndices;
+	for (int i = 0; i < dataFiles.length(); i ++)
+		dataFileIndices[dataFiles.at(i).name.toStdString()] = i;
+	for (int i = 0; i < v2Files.length(); i ++)
+	{
+		/* A single file named as the torrent is stored as in a v1 single-file torrent. */
+		FileResult & r = fileResults[i];
+		r.name = torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name;
+		if (bitTorrent.torrent_details.files.length())
+			r.name += '/' + v2Files.at(i).path.join('/');
+		const auto dataFile = dataFileIndices.find(r.name.toStdString());
+		if (dataFile != dataFileIndices.end())
+			r.md5Hashes = expectedMd5Hashes(dataFiles.at(dataFile->second), options);
+		firstPieces.push_back(firstPieces.back() + (v2Files.at(i).length + piece_length - 1) / piece_length);
+	}
+	const int64_t total_piece_count = firstPieces.back();
+
+	/* When resuming, the files before the resume point have already been verified, and the file containing it is
+	 * verified from its start. */
+	resume_piece = std::min(resume_piece, total_piece_count);
+	int resume_file = 0;
+	while (resume_file < v2Files.length() && firstPieces.at(resume_file + 1) <= resume_piece)
+		resume_file ++;
+	resume_piece = firstPieces.at(resume_file);
+	if (resume_piece)
+		qInfo().noquote() << QString("Resuming verification at piece %1 of %2.").arg(resume_piece).arg(total_piece_count);
+
+	/* Find the pieces, which have been verified by a previous run, of files that have not changed since. Files which are
+	 * checked for MD5 hashes must be read in their entirety, so their pieces are never skipped. The v2 results are cached
+	 * under the v2 info-hash, apart from the v1 results of a hybrid torrent. */
+	std::vector<VerificationCache::FileStamp> fileStamps;
+	std::vector<bool> verifiedPieces(total_piece_count, false);
+	uint64_t skipped_length = 0;
+	int64_t skipped_pieces = 0;
+	if (options.cache)
+	{
+		for (const auto & r : fileResults)
+			fileStamps.push_back(VerificationCache::FileStamp::of(r.name));
+		VerificationCache::Entry entry;
+		if (!options.full_verification && options.cache->load(bitTorrent.torrent_details.info_hash_v2, piece_length, total_piece_count, v2Files.length(), entry))
+			for (int i = resume_file; i < v2Files.length(); i ++)
+				if (entry.files.at(i) == fileStamps.at(i) && !fileResults.at(i).md5Hashes.length())
+					for (int64_t piece_index = firstPieces.at(i); piece_index < firstPieces.at(i + 1); piece_index ++)
+						verifiedPieces[piece_index] = entry.verified_pieces.at(piece_index);
+	}
+	for (int i = resume_file; i < v2Files.length(); i ++)
+		for (int64_t piece_index = firstPieces.at(i); piece_index < firstPieces.at(i + 1); piece_index ++)
+			if (!verifiedPieces.at(piece_index))
+				fileResults[i].pieces.push_back(piece_index - firstPieces.at(i));
+			else
+			{
+				const uint64_t offset = (piece_index - firstPieces.at(i)) * piece_length;
+				skipped_length += std::min(piece_length, (uint64_t) v2Files.at(i).length - offset);
+				skipped_pieces ++;
+			}
+
+	/* Each hashing thread reads its files with a read engine of its own, into buffers of its own. */
+	const unsigned thread_count = std::max(std::min(options.hash_thread_count, (unsigned) v2Files.length()), 1u);
+	std::vector<std::unique_ptr<ReadEngine>> readEngines;
+	std::vector<std::unique_ptr<PieceBufferPool>> bufferPools;
+	if (!options.memory_map_files)
+		for (unsigned i = 0; i < thread_count; i ++)
+		{
+			readEngines.push_back(ReadEngine::create(options.io_engine, options.io_queue_depth, options.drop_cache));
+			bufferPools.push_back(std::make_unique<PieceBufferPool>(piece_length, readEngines.back()->queueDepth()));
+		}
+
+	std::function<void(int file_index, ReadEngine * readEngine, PieceBufferPool * bufferPool)> verifyFile =
+			[&] (int file_index, ReadEngine * readEngine, PieceBufferPool * bufferPool) -> void {
+		const BitTorrent::TorrentDetails::v2_file_info & f = v2Files.at(file_index);
+		FileResult & r = fileResults[file_index];
+		/* Empty files have no hashes, and there is nothing to hash in verified files. */
+		if (!r.pieces.size())
+			return;
+		const int64_t piece_count = firstPieces.at(file_index + 1) - firstPieces.at(file_index);
+		QByteArray layer;
+		if (piece_count > 1)
+		{
+			const auto l = bitTorrent.piece_layers.find(f.pieces_root);
+			if (l == bitTorrent.piece_layers.end() || (int64_t) l->second.size() != piece_count * MerkleTree::HASH_SIZE)
+			{
+				r.error = "The torrent has no valid piece layer for file";
+				return;
+			}
+			layer = l->second;
+			std::vector<QByteArray> pieceHashes;
+			for (int64_t piece_index = 0; piece_index < piece_count; piece_index ++)
+				pieceHashes.push_back(layer.mid(piece_index * MerkleTree::HASH_SIZE, MerkleTree::HASH_SIZE));
+			if (MerkleTree::root(pieceHashes, MerkleTree::powerOfTwo(piece_count), MerkleTree::zeroRoot(blocks_per_piece)) != f.pieces_root)
+			{
+				r.error = "The piece layer in the torrent does not match the 'pieces root' of file";
+				return;
+			}
+		}
+
+		DataFile file(r.name);
+		{
+			StageTimer openTimer(Metrics::OPEN);
+			if (!file.open(options.memory_map_files, options.direct_io))
+			{
+				r.error = "Could not open file for reading:";
+				return;
+			}
+		}
+		std::unique_ptr<QCryptographicHash> md5;
+		if (r.md5Hashes.length())
+			md5 = std::make_unique<QCryptographicHash>(QCryptographicHash::Md5);
+
+		/* The pieces are read in batches of up to the queue depth of the read engine, as in 'verify_torrent_hashes()'. */
+		const size_t batch_size = readEngine ? readEngine->queueDepth() : 1;
+		for (size_t first_piece = 0; first_piece < r.pieces.size(); first_piece += batch_size)
+		{
+			if (options.cancelled && * options.cancelled)
+				return;
+			const size_t end_piece = std::min(first_piece + batch_size, r.pieces.size());
+			std::vector<std::shared_ptr<char>> buffers;
+			std::vector<ReadRequest> requests;
+			if (readEngine)
+			{
+				for (size_t n = first_piece; n < end_piece; n ++)
+				{
+					const uint64_t offset = r.pieces.at(n) * piece_length;
+					buffers.push_back(bufferPool->acquire());
+					requests.push_back(ReadRequest { & file, offset, buffers.back().get(), std::min(piece_length, (uint64_t) f.length - offset) });
+				}
+				const uint64_t read_start = Metrics::now();
+				const bool read_ok = readEngine->read(requests);
+				metrics.record(Metrics::IO_WAIT, Metrics::now() - read_start);
+				if (!read_ok)
+				{
+					r.error = "Error reading file:";
+					return;
+				}
+			}
+			for (size_t n = first_piece; n < end_piece; n ++)
+			{
+				const int64_t piece_index = r.pieces.at(n);
+				const uint64_t offset = piece_index * piece_length, length = std::min(piece_length, (uint64_t) f.length - offset);
+				QByteArrayView data;
+				if (readEngine)
+					data = QByteArrayView(requests.at(n - first_piece).buffer, length);
+				else
+				{
+					/* Memory-mapped data is read while it is being hashed, so only its rate can be limited. */
+					if (throttle.isActive())
+						throttled_ns += throttle.acquireRate(length);
+					data = file.view(offset, length);
+				}
+				deviceBytes += length;
+				if (md5)
+				{
+					StageTimer md5Timer(Metrics::MD5);
+					md5->addData(data);
+				}
+				const uint64_t hash_start = Metrics::now();
+				/* The last piece of a file is padded to the full piece size, a file of a single piece only to a power of two blocks. */
+				const QByteArray pieceRoot = MerkleTree::pieceRoot(data,
+						piece_count > 1 ? blocks_per_piece : MerkleTree::powerOfTwo((length + MerkleTree::LEAF_SIZE - 1) / MerkleTree::LEAF_SIZE));
+				metrics.record(Metrics::HASH, Metrics::now() - hash_start);
+				metrics.pieces_hashed ++;
+				if (pieceRoot != (piece_count > 1 ? layer.mid(piece_index * MerkleTree::HASH_SIZE, MerkleTree::HASH_SIZE) : f.pieces_root))
+				{
+					r.corrupted_pieces.push_back(piece_index);
+					metrics.pieces_corrupted ++;
+				}
+				r.hashed_length += length;
+				/* The read engine drops the data it has read from the page cache itself. */
+				if (options.drop_cache && !readEngine)
+					file.dropCache(offset, length);
+			}
+		}
+		if (md5)
+			r.md5 = md5->result();
+	};
+
+	/* Reports the verified files in file order, as far as all files before them have been verified, and makes
+	 * a checkpoint after them, when due. Called with the report mutex locked. */
+	std::mutex reportMutex;
+	int reported_files = resume_file;
+	bool result = true, errors = false;
+	uint64_t total_length = 0;
+	QElapsedTimer checkpointTimer;
+	checkpointTimer.start();
+	std::function<void(void)> reportFiles = [&] (void) -> void {
+		for (; reported_files < v2Files.length() && fileResults.at(reported_files).done; reported_files ++)
+		{
+			const FileResult & r = fileResults.at(reported_files);
+			total_length += r.hashed_length;
+			if (r.error.length())
+			{
+				qCritical().noquote() << r.error << r.name;
+				result = false;
+				errors = true;
+				continue;
+			}
+			for (const auto piece_index : r.pieces)
+				verifiedPieces[firstPieces.at(reported_files) + piece_index] = true;
+			if (r.corrupted_pieces.size())
+			{
+				QStringList pieces;
+				for (const auto piece_index : r.corrupted_pieces)
+				{
+					verifiedPieces[firstPieces.at(reported_files) + piece_index] = false;
+					pieces << QString::number(piece_index);
+					if (options.results)
+						options.results->corruptedPiece(checkResult.torrent_filename, piece_index, QStringList(r.name));
+				}
+				qCritical().noquote() << QCoreApplication::translate("Main", "ERROR: SHA-256 hash mismatch, in piece(s) %1 of file:").arg(pieces.join(", ")) << r.name;
+				if (!checkResult.corrupted_files_by_sha256_checksum.contains(r.name))
+					checkResult.corrupted_files_by_sha256_checksum << r.name;
+				result = false;
+			}
+			const QString md5Hash = r.md5.toHex().toLower();
+			for (const auto & expected : r.md5Hashes)
+				if (md5Hash != expected)
+				{
+					result = false;
+					qCritical().noquote() << "ERROR: MD5 hash mismatch for file" << r.name;
+					qCritical().noquote() << "ERROR: expected MD5 hash:" << expected << "; computed MD5 hash:" << md5Hash;
+					if (!checkResult.corrupted_files_by_md5_checksum.contains(r.name))
+						checkResult.corrupted_files_by_md5_checksum << r.name;
+				}
+		}
+		/* A file which could not be verified fails the torrent, so verification does not resume after it. */
+		if (checkpoint && !errors && checkpointTimer.elapsed() >= CheckpointJournal::CHECKPOINT_INTERVAL_MS)
+		{
+			checkpoint(firstPieces.at(reported_files));
+			checkpointTimer.restart();
+		}
+	};
+
+	/* Verify the files in parallel. */
+	std::atomic<int> next_file { resume_file };
+	std::function<void(unsigned thread_index)> worker = [&] (unsigned thread_index) -> void {
+		ReadEngine * readEngine = readEngines.size() ? readEngines.at(thread_index).get() : 0;
+		PieceBufferPool * bufferPool = bufferPools.size() ? bufferPools.at(thread_index).get() : 0;
+		int file_index;
+		while ((file_index = next_file ++) < v2Files.length())
+		{
+			verifyFile(file_index, readEngine, bufferPool);
+			/* A file which has not been verified completely is not reported. */
+			if (options.cancelled && * options.cancelled)
+				return;
+			std::lock_guard<std::mutex> lock(reportMutex);
+			fileResults[file_index].done = true;
+			reportFiles();
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < thread_count; i ++)
+		workers.emplace_back(worker, i);
+	worker(0);
+	for (auto & w : workers)
+		w.join();
+	for (const auto & e : readEngines)
+		throttled_ns += e->throttledNs();
+	if (options.cancelled && * options.cancelled)
+		return false;
+
+	if (options.cache)
+	{
+		if (skipped_length)
+			qInfo().noquote() << QString("Skipped %1 bytes in %2 pieces, which have not changed since they were last verified.")
+					     .arg(skipped_length).arg(skipped_pieces);
+		VerificationCache::Entry entry;
+		entry.piece_length = piece_length;
+		entry.files = fileStamps;
+		entry.verified_pieces = verifiedPieces;
+		options.cache->store(bitTorrent.torrent_details.info_hash_v2, entry);
+	}
+
+	uint64_t milliseconds = timer.elapsed();
+	checkResult.hashed_length += total_length;
+	checkResult.elapsed_ms += milliseconds;
+	checkResult.throttled_ms += throttled_ns / 1000000;
+	qInfo().noquote() << QString("Average speed %2 megabytes/second (v2, %3 files at a time, read engine: %4%5).")
+			     .arg((((double) total_length / milliseconds) * 1000.) / (1 << 20))
+			     .arg(std::max(options.hash_thread_count, 1u))
+			     .arg(readEngines.size() ? readEngines.front()->name() : "mmap")
+			     .arg(throttledTimeNote(throttled_ns / 1000000));
+	return result;
+}
+
+/* Verifies the data of a torrent. Verification may start at a later piece, when resuming an interrupted verification
+ * - the pieces before 'resume_piece' are then assumed to have been verified, with any failures already in 'checkResult'.
+ * If a checkpoint function is specified, it is called periodically with the index of the first piece that has not been
+ * verified yet; all pieces before it have been verified, and their failures have been added to 'checkResult'. */
+inline bool verify_torrent_hashes(const QString & torrentDataDirectoryName, const BitTorrent & bitTorrent,
+		const VerificationOptions & options, struct TorrentCheckResult & checkResult,
+		int64_t resume_piece = 0, const std::function<void(int64_t next_piece)> & checkpoint = nullptr)
+{
+	QElapsedTimer timer;
+	timer.start();
+	const uint64_t piece_length = bitTorrent.torrent_details.piece_length;
+	uint64_t total_length = 0;
+
+	/* Construct the list of filenames. */
+	const QList<TorrentDataFile> dataFiles = torrentDataFiles(torrentDataDirectoryName, bitTorrent);
+	QStringList fileNames;
+	QList<uint64_t> fileSizes;
+	/* The expected MD5 hashes of each file, if MD5 checking is requested. */
+	std::vector<QStringList> fileMd5Hashes;
+	for (const auto & f : dataFiles)
+	{
+		fileNames << f.name;
+		fileSizes << f.size;
+		fileMd5Hashes.push_back(expectedMd5Hashes(f, options));
+	}
+
+	/* With a piece selection, only the files spanned by the selected pieces are checked - other files of the torrent may
+	 * e.g. still be being downloaded. Files which are checked for MD5 hashes are read in their entirety, so the files
+	 * sharing pieces with them are checked, too. */
+	std::vector<bool> checkedFiles(fileNames.length(), !options.piece_selection);
+	if (options.piece_selection)
+	{
+		std::vector<int64_t> selection = * options.piece_selection;
+		std::sort(selection.begin(), selection.end());
+		std::vector<std::pair<int64_t, int64_t>> filePieces;
+		uint64_t offset = 0;
+		for (const auto size : fileSizes)
+		{
+			filePieces.push_back(std::make_pair(offset / piece_length, (offset + std::max(size, (uint64_t) 1) - 1) / piece_length));
+			offset += size;
+		}
+		for (int i = 0; i < fileNames.length(); i ++)
+		{
+			const auto p = std::lower_bound(selection.begin(), selection.end(), filePieces.at(i).first);
+			checkedFiles[i] = p != selection.end() && * p <= filePieces.at(i).second;
+		}
+		/* The files are in data offset order, so the files sharing pieces with a file are its neighbours. */
+		for (bool added = true; added; )
+		{
+			added = false;
+			for (int i = 0; i < fileNames.length(); i ++)
+				if (checkedFiles.at(i) && fileMd5Hashes.at(i).length())
+				{
+					for (int j = i - 1; j >= 0 && filePieces.at(j).second >= filePieces.at(i).first; j --)
+						if (!checkedFiles.at(j))
+							added = checkedFiles[j] = true;
+					for (int j = i + 1; j < fileNames.length() && filePieces.at(j).first <= filePieces.at(i).second; j ++)
+						if (!checkedFiles.at(j))
+							added = checkedFiles[j] = true;
+				}
+		}
+	}
+
+	for (int i = 0; i < fileNames.length(); i ++)
+	{
+		const QString & f = fileNames.at(i);
+		if (dataFiles.at(i).padding || !checkedFiles.at(i))
+			continue;
+		bool exists, isFile;
+		uint64_t size;
+		if (options.size_scan)
+		{
+			/* The files have already been checked, in a bulk scan of the files of all torrents. */
+			const FileSizeScanner::Entry * entry = options.size_scan->find(f);
+			exists = entry && entry->status != FileSizeScanner::MISSING;
+			isFile = exists && entry->status == FileSizeScanner::REGULAR_FILE;
+			size = exists ? entry->size : 0;
+		}
+		else
+		{
+			StageTimer statTimer(Metrics::STAT);
+			QFileInfo fi(f);
+			exists = fi.exists();
+			isFile = fi.isFile();
+			size = fi.size();
+		}
+		if (!exists)
+		{
+			qCritical() << "File does not exist:" << f;
+			return false;
+		}
+		if (!isFile)
+		{
+			qCritical() << "Invalid filename, not a file:" << f;
+			return false;
+		}
+		if (size != fileSizes.at(i))
+		{
+			qCritical() << "File size mismatch for file" << f << "Expected:" << fileSizes.at(i) << ", actual:" << size;
+			return false;
+		}
+	}
+	if (options.check_size_only)
+		return true;
+
+	if (options.hash_version == 1 && !bitTorrent.hasV1Hashes())
+	{
+		qCritical() << "The torrent has no v1 (SHA1) piece hashes.";
+		return false;
+	}
+	if (options.hash_version == 2 && !bitTorrent.hasV2Hashes())
+	{
+		qCritical() << "The torrent has no v2 (SHA-256 Merkle tree) hashes.";
+		return false;
+	}
+	/* Sampled and selected pieces are v1 pieces, so a hybrid torrent is then verified with its v1 hashes. */
+	if (bitTorrent.hasV2Hashes() && options.hash_version != 1
+			&& !(selectsV1Pieces(bitTorrent, options) && (options.sample_fraction || options.sample_count || options.piece_selection)))
+		return verify_torrent_v2_data(torrentDataDirectoryName, bitTorrent, dataFiles, options, checkResult, resume_piece, checkpoint);
+
+	const TorrentDataLayout layout(fileNames, fileSizes, piece_length);
+	if (layout.pieceCount() != bitTorrent.pieceCount())
+	{
+		qCritical() << "Piece count mismatch, the torrent data is" << layout.totalLength() << "bytes long, which makes" << layout.pieceCount()
+			<< "pieces, but the torrent contains" << bitTorrent.pieceCount() << "piece hashes.";
+		return false;
+	}
+
+	/* When resuming in the middle of a file, which is checked for an MD5 hash, resume at the start of the file instead,
+	 * as the MD5 hash must be computed over the whole file. */
+	resume_piece = std::min(resume_piece, layout.pieceCount());
+	for (bool moved = true; moved; )
+	{
+		moved = false;
+		for (int i = 0; i < (int) layout.fileList().size(); i ++)
+		{
+			const TorrentDataLayout::File & f = layout.fileList().at(i);
+			if (f.offset < layout.pieceOffset(resume_piece) && f.offset + f.length > layout.pieceOffset(resume_piece) && fileMd5Hashes.at(i).length())
+			{
+				resume_piece = f.offset / piece_length;
+				moved = true;
+			}
+		}
+	}
+	if (resume_piece)
+		qInfo().noquote() << QString("Resuming verification at piece %1 of %2.").arg(resume_piece).arg(layout.pieceCount());
+
+	/* Find the pieces, which have been verified by a previous run, and only span files that have not changed since.
+	 * Files which are checked for MD5 hashes must be read in their entirety, so their pieces are never skipped. */
+	std::vector<VerificationCache::FileStamp> fileStamps;
+	std::vector<bool> verifiedPieces(layout.pieceCount(), false);
+	std::vector<int64_t> piecesToHash;
+	uint64_t skipped_length = 0;
+	if (options.cache)
+	{
+		for (const auto & f : fileNames)
+			fileStamps.push_back(VerificationCache::FileStamp::of(f));
+		VerificationCache::Entry entry;
+		if (!options.full_verification && options.cache->load(bitTorrent.torrent_details.info_hash, piece_length, layout.pieceCount(), fileNames.length(), entry))
+		{
+			std::vector<bool> unchangedFiles(fileNames.length());
+			for (int i = 0; i < fileNames.length(); i ++)
+				unchangedFiles[i] = entry.files.at(i) == fileStamps.at(i) && !fileMd5Hashes.at(i).length();
+			for (int64_t piece_index = 0; piece_index < layout.pieceCount(); piece_index ++)
+			{
+				bool unchanged = entry.verified_pieces.at(piece_index);
+				for (const auto & segment : layout.pieceSegments(piece_index))
+					unchanged = unchanged && unchangedFiles.at(segment.file_index);
+				verifiedPieces[piece_index] = unchanged;
+			}
+		}
+	}
+	for (int64_t piece_index = 0; piece_index < layout.pieceCount(); piece_index ++)
+		if (piece_index < resume_piece)
+			/* The outcome of these pieces is not known here, so do not record them as verified in the cache. */
+			verifiedPieces[piece_index] = false;
+		else if (!verifiedPieces.at(piece_index))
+			piecesToHash.push_back(piece_index);
+		else
+			skipped_length += layout.pieceSize(piece_index);
+	/* Spot checks are meant to find silent data corruption, which the cache can not tell about, so the sample is drawn
+	 * from all pieces. Pieces outside of the sample keep their cached state. */
+	const bool sampling = options.sample_fraction || options.sample_count;
+	if (sampling)
+	{
+		std::vector<int64_t> candidates;
+		for (int64_t piece_index = resume_piece; piece_index < layout.pieceCount(); piece_index ++)
+			candidates.push_back(piece_index);
+		piecesToHash = PieceSampler::select(layout, candidates, PieceSampler::sampleSize(candidates.size(), options.sample_fraction, options.sample_count),
+				options.sample_seed, bitTorrent.torrent_details.info_hash);
+		skipped_length = 0;
+		checkResult.piece_count = layout.pieceCount();
+		checkResult.sampled_pieces = piecesToHash.size();
+	}
+	else if (options.piece_selection)
+	{
+		/* Files which are checked for MD5 hashes must be read in their entirety, so select all pieces of such files. */
+		std::vector<bool> selected(layout.pieceCount(), false);
+		for (const auto piece_index : * options.piece_selection)
+			if (piece_index >= resume_piece && piece_index < layout.pieceCount())
+				selected[piece_index] = true;
+		for (bool added = true; added; )
+		{
+			added = false;
+			for (int i = 0; i < (int) layout.fileList().size(); i ++)
+			{
+				const TorrentDataLayout::File & f = layout.fileList().at(i);
+				if (!f.length || !fileMd5Hashes.at(i).length())
+					continue;
+				const int64_t first_piece = f.offset / piece_length, last_piece = (f.offset + f.length - 1) / piece_length;
+				if (std::find(selected.begin() + first_piece, selected.begin() + last_piece + 1, true) == selected.begin() + last_piece + 1
+						|| std::find(selected.begin() + first_piece, selected.begin() + last_piece + 1, false) == selected.begin() + last_piece + 1)
+					continue;
+				std::fill(selected.begin() + first_piece, selected.begin() + last_piece + 1, true);
+				added = true;
+			}
+		}
+		piecesToHash.clear();
+		for (int64_t piece_index = 0; piece_index < layout.pieceCount(); piece_index ++)
+			if (selected.at(piece_index))
+				piecesToHash.push_back(piece_index);
+		skipped_length = 0;
+	}
+	/* For checkpoints - the pieces to hash, which have been reported so far, and the number of these that
+	 * have been reported without gaps from the start. */
+	std::vector<bool> reportedPieces(piecesToHash.size(), false);
+	size_t reported_prefix = 0;
+	QElapsedTimer checkpointTimer;
+	checkpointTimer.start();
+
+	Metrics & metrics = Metrics::instance();
+	std::atomic<uint64_t> & deviceBytes = metrics.deviceBytes(TorrentScheduler::deviceId(torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name));
+	ReadThrottle & throttle = ReadThrottle::instance();
+	/* The time waited for the read rate limit when memory-mapping the data; the read engine accounts for its own reads. */
+	uint64_t throttled_ns = 0;
+
+	std::function<bool(const PieceResult & pieceResult)> reportPieceResult = [&] (const PieceResult & pieceResult) -> bool {
+		total_length += pieceResult.length;
+		verifiedPieces[pieceResult.piece_index] = pieceResult.ok;
+		reportedPieces[std::lower_bound(piecesToHash.begin(), piecesToHash.end(), pieceResult.piece_index) - piecesToHash.begin()] = true;
+		if (pieceResult.ok)
+			return true;
+		QString affectedFiles;
+		for (const auto & t : pieceResult.files)
+			affectedFiles += '"' + t + '"' + ", ";
+		affectedFiles.chop(2);
+		qCritical().noquote() << QCoreApplication::translate("Main", "ERROR: SHA1 hash mismatch, affected file(s) in the corrupted torrent piece:") << affectedFiles;
+		for (const auto & t : pieceResult.files)
+			if (!checkResult.corrupted_files_by_sha1_checksum.contains(t))
+				checkResult.corrupted_files_by_sha1_checksum << t;
+		metrics.pieces_corrupted ++;
+		if (sampling)
+			checkResult.corrupted_sampled_pieces ++;
+		if (options.results)
+			options.results->corruptedPiece(checkResult.torrent_filename, pieceResult.piece_index, pieceResult.files);
+		return false;
+	};
+
+	std::unique_ptr<ReadEngine> readEngine;
+	/* Enough piece buffers for all pieces queued in, and being hashed by, the pipeline, plus a batch of pieces being read.
+	 * The queue holds two pieces per worker, and each worker hashes one more; with a multi-buffer SHA1 kernel, the queue
+	 * holds a full batch of pieces per worker, and each worker hashes another full batch at once (see 'PieceHashPipeline'). */
+	std::unique_ptr<PieceBufferPool> bufferPool;
+	const bool md5_checking = std::any_of(fileMd5Hashes.begin(), fileMd5Hashes.end(), [] (const QStringList & h) -> bool { return h.length(); });
+	if (!options.memory_map_files)
+	{
+		const unsigned piecesPerWorker = Sha1::isMultiBuffer() ? 2 * Sha1::MAX_LANES : 3;
+		readEngine = ReadEngine::create(options.io_engine, options.io_queue_depth, options.drop_cache);
+		bufferPool = std::make_unique<PieceBufferPool>(piece_length, piecesPerWorker * options.hash_thread_count + readEngine->queueDepth()
+				+ (md5_checking ? FileMd5Worker::QUEUE_CAPACITY : 0));
+	}
+	/* If requested, hash the data pieces in a pool of worker threads, while this thread keeps reading data. Declared after
+	 * the buffer pool, so that the pieces still queued when verification stops early are hashed, and their buffers
+	 * released, before the pool is destroyed. */
+	std::unique_ptr<PieceHashPipeline> pipeline;
+	if (options.hash_thread_count)
+		pipeline = std::make_unique<PieceHashPipeline>(bitTorrent, options.hash_thread_count);
+	/* If any files are checked for MD5 hashes, compute these in a worker of their own. Declared after the buffer pool,
+	 * so that it releases its buffers before the pool is destroyed. */
+	std::unique_ptr<FileMd5Worker> md5Worker;
+	if (md5_checking)
+		md5Worker = std::make_unique<FileMd5Worker>();
+
+	/* Per-file state, for the files being read. Files are opened when their first piece is read,
+	 * and closed (or unmapped) when the last piece that references them has been hashed. */
+	struct FileState
+	{
+		std::shared_ptr<DataFile> file;
+		/* Set if the file is being hashed by the MD5 worker. */
+		bool md5 = false;
+	};
+	std::vector<FileState> fileStates(fileNames.length());
+	/* The data of padding files, when memory-mapping the data files. */
+	std::shared_ptr<char> zeroPiece;
+	/* When resuming, the files before the resume point have already been completed. */
+	int completed_files = layout.fileAt(layout.pieceOffset(resume_piece));
+
+	/* Reports and closes the files, which end at or before the specified offset in the torrent data stream. */
+	std::function<void(uint64_t offset)> completeFiles = [&] (uint64_t offset) -> void {
+		for (; completed_files < (int) layout.fileList().size(); completed_files ++)
+		{
+			const TorrentDataLayout::File & f = layout.fileList().at(completed_files);
+			if (f.offset + f.length > offset)
+				break;
+			FileState & state = fileStates.at(completed_files);
+			state.file.reset();
+			if (options.verbose)
+			{
+				qInfo() << "Processed file" << f.name;
+				if (options.compute_md5_hashes)
+				{
+					if (state.md5)
+						qInfo() << "Also computing the MD5 hash for file" << f.name;
+					else
+						qInfo() << "NOTE: requested computing the MD5 hash for file" << f.name << ", but the torrent has no 'md5sum' key for the file, and filename not recognized as an MD5 hash value, did not compute MD5 hash value for this file.";
+				}
+			}
+			if (state.md5)
+				md5Worker->complete(completed_files);
+		}
+	};
+	/* Compares the MD5 hashes of completed files to the expected hashes. */
+	std::function<bool(const std::vector<FileMd5Worker::Result> & md5Results)> reportMd5Results =
+			[&] (const std::vector<FileMd5Worker::Result> & md5Results) -> bool {
+		bool result = true;
+		for (const auto & md5Result : md5Results)
+		{
+			const QString & f = fileNames.at(md5Result.file_index);
+			const QString md5Hash = md5Result.md5.toHex().toLower();
+			for (const auto & expected : fileMd5Hashes.at(md5Result.file_index))
+				if (md5Hash != expected)
+				{
+					result = false;
+					qCritical().noquote() << "ERROR: MD5 hash mismatch for file" << f;
+					qCritical().noquote() << "ERROR: expected MD5 hash:" << expected << "; computed MD5 hash:" << md5Hash;
+					if (!checkResult.corrupted_files_by_md5_checksum.contains(f))
+						checkResult.corrupted_files_by_md5_checksum << f;
+				}
+		}
+		return result;
+	};
+
+	/* The pieces are read in batches of up to the queue depth of the read engine, so that asynchronous read engines
+	 * can keep several reads in flight. The pieces of a batch are then hashed and reported strictly in order. */
+	const size_t batch_size = readEngine ? readEngine->queueDepth() : 1;
+	bool result = true;
+	for (size_t first_piece = 0; first_piece < piecesToHash.size(); first_piece += batch_size)
+	{
+		if (options.cancelled && * options.cancelled)
+			return false;
+		std::vector<PieceJob> jobs;
+		/* The index of the data file, for each segment of each piece in the batch. */
+		std::vector<std::vector<int>> segmentFiles;
+		std::vector<ReadRequest> requests;
+		for (size_t n = first_piece; n < std::min(first_piece + batch_size, piecesToHash.size()); n ++)
+		{
+			const int64_t piece_index = piecesToHash.at(n);
+			PieceJob job;
+			job.piece_index = piece_index;
+			/* Memory-mapped data is read while it is being hashed, so only its rate can be limited, per piece. */
+			if (options.memory_map_files && throttle.isActive())
+				throttled_ns += throttle.acquireRate(layout.pieceSize(piece_index));
+			std::shared_ptr<char> buffer;
+			uint64_t buffer_offset = 0;
+			if (bufferPool)
+			{
+				buffer = bufferPool->acquire();
+				job.storage.push_back(buffer);
+			}
+			segmentFiles.push_back(std::vector<int>());
+			for (const auto & segment : layout.pieceSegments(piece_index))
+			{
+				FileState & state = fileStates.at(segment.file_index);
+				const QString & f = fileNames.at(segment.file_index);
+				segmentFiles.back().push_back(segment.file_index);
+				if (dataFiles.at(segment.file_index).padding)
+				{
+					/* Padding files are not stored, their data is all zeros. */
+					if (options.memory_map_files)
+					{
+						if (!zeroPiece)
+							zeroPiece = std::shared_ptr<char>(new char[piece_length](), std::default_delete<char[]>());
+						job.segments.push_back(QByteArrayView(zeroPiece.get(), segment.length));
+						job.storage.push_back(zeroPiece);
+					}
+					else
+					{
+						memset(buffer.get() + buffer_offset, 0, segment.length);
+						job.segments.push_back(QByteArrayView(buffer.get() + buffer_offset, segment.length));
+						buffer_offset += segment.length;
+					}
+					continue;
+				}
+				if (!state.file)
+				{
+					state.file = std::make_shared<DataFile>(f);
+					StageTimer openTimer(Metrics::OPEN);
+					if (!state.file->open(options.memory_map_files, options.direct_io))
+					{
+						qCritical() << "Could not open file for reading:" << f;
+						return false;
+					}
+					/* If an MD5 hash is expected for the file, compute the MD5 hash of the file, and compare it to the expected hash.
+					 * This is only possible if the file is read from its start. */
+					state.md5 = !segment.file_offset && fileMd5Hashes.at(segment.file_index).length();
+				}
+				if (options.memory_map_files)
+				{
+					job.segments.push_back(state.file->view(segment.file_offset, segment.length));
+					job.storage.push_back(state.file);
+				}
+				else
+				{
+					requests.push_back(ReadRequest { state.file.get(), segment.file_offset, buffer.get() + buffer_offset, segment.length });
+					job.segments.push_back(QByteArrayView(buffer.get() + buffer_offset, segment.length));
+					buffer_offset += segment.length;
+				}
+				job.files << f;
+			}
+			jobs.push_back(std::move(job));
+		}
+
+		const uint64_t read_start = Metrics::now();
+		const bool read_ok = !requests.size() || readEngine->read(requests);
+		if (requests.size())
+			metrics.record(Metrics::IO_WAIT, Metrics::now() - read_start);
+		if (!read_ok)
+		{
+			for (const auto & request : requests)
+				if (!request.ok)
+					qCritical() << "Error reading file:" << request.file->fileName();
+			return false;
+		}
+
+		for (size_t i = 0; i < jobs.size(); i ++)
+		{
+			PieceJob & job = jobs.at(i);
+			const int64_t piece_index = job.piece_index;
+			for (size_t segment = 0; segment < job.segments.size(); segment ++)
+			{
+				const int file_index = segmentFiles.at(i).at(segment);
+				if (fileStates.at(file_index).md5)
+					md5Worker->add(file_index, job.segments.at(segment), job.storage);
+			}
+			deviceBytes += job.length();
+			if (pipeline)
+				/* The result will be reported when the pipeline is drained. */
+				pipeline->submit(std::move(job));
+			else
+			{
+				const uint64_t hash_start = Metrics::now();
+				const QByteArray digest = job.sha1();
+				metrics.record(Metrics::HASH, Metrics::now() - hash_start);
+				metrics.pieces_hashed ++;
+				bool ok = bitTorrent.pieceHashMatches(piece_index, digest);
+				result &= reportPieceResult(PieceResult { piece_index, job.length(), ok, job.files });
+				job = PieceJob();
+			}
+			completeFiles(layout.pieceOffset(piece_index) + layout.pieceSize(piece_index));
+		}
+		if (md5Worker)
+			result &= reportMd5Results(md5Worker->takeResults());
+
+		/* Pieces between the sampled pieces are not verified, so a sample run records no checkpoints. */
+		if (checkpoint && !sampling && !options.piece_selection && checkpointTimer.elapsed() >= CheckpointJournal::CHECKPOINT_INTERVAL_MS)
+		{
+			if (pipeline)
+				for (const auto & pieceResult : pipeline->takeResults())
+					result &= reportPieceResult(pieceResult);
+			/* The MD5 hashes of the files completed so far must also be known. */
+			if (md5Worker)
+				result &= reportMd5Results(md5Worker->wait());
+			while (reported_prefix < reportedPieces.size() && reportedPieces.at(reported_prefix))
+				reported_prefix ++;
+			checkpoint(reported_prefix < piecesToHash.size() ? piecesToHash.at(reported_prefix) : layout.pieceCount());
+			checkpointTimer.restart();
+		}
+	}
+	/* Also handle any trailing zero-length files. */
+	completeFiles(layout.totalLength());
+
+	if (pipeline)
+		for (const auto & pieceResult : pipeline->finish())
+			result &= reportPieceResult(pieceResult);
+	if (md5Worker)
+		result &= reportMd5Results(md5Worker->finish());
+
+	if (options.cache)
+	{
+		if (skipped_length)
+			qInfo().noquote() << QString("Skipped %1 bytes in %2 pieces, which have not changed since they were last verified.")
+					     .arg(skipped_length).arg(layout.pieceCount() - (int64_t) piecesToHash.size());
+		VerificationCache::Entry entry;
+		entry.piece_length = piece_length;
+		entry.files = fileStamps;
+		entry.verified_pieces = verifiedPieces;
+		options.cache->store(bitTorrent.torrent_details.info_hash, entry);
+	}
+
+	if (sampling)
+		qInfo().noquote() << QString("Verified a sample of %1 out of %2 pieces, %3 corrupted.")
+				     .arg(checkResult.sampled_pieces).arg(checkResult.piece_count).arg(checkResult.corrupted_sampled_pieces);
+
+	uint64_t milliseconds = timer.elapsed();
+	checkResult.hashed_length += total_length;
+	checkResult.elapsed_ms += milliseconds;
+	if (readEngine)
+		throttled_ns += readEngine->throttledNs();
+	checkResult.throttled_ms += throttled_ns / 1000000;
+	qInfo().noquote() << QString("Average speed %2 megabytes/second (read engine: %3, SHA1 kernel: %4%5).")
+			     .arg((((double) total_length / milliseconds) * 1000.) / (1 << 20))
+			     .arg(readEngine ? readEngine->name() : "mmap")
+			     .arg(Sha1::kernelName())
+			     .arg(throttledTimeNote(throttled_ns / 1000000));
+
+	return result;
+}
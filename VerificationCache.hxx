@@ -0,0 +1,143 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDateTime>
+
+#include <cstring>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+/* A persistent cache of verification results, for incremental re-verification of data that has not changed.
+ *
+ * For each torrent, keyed by the torrent info-hash, the cache records which pieces were verified successfully, together with
+ * the identity and modification state - a 'FileStamp' - of every data file of the torrent at the time of verification.
+ * A later verification may skip a cached piece, if all files that the piece spans still have the same stamps.
+ * Pieces that overlap modified, replaced or new files, and pieces that failed verification, are always hashed again.
+ *
+ * Note that this can not detect silent data corruption, which does not change the file stamps, so a full verification
+ * should still be run from time to time.
+ *
+ * Each torrent is stored in its own file in the cache directory, named after the hexadecimal info-hash.
+ * The files are written atomically, in host byte order - the cache is not meant to be moved between machines. */
+class VerificationCache
+{
+public:
+	struct FileStamp
+	{
+		uint64_t device = 0;
+		uint64_t inode = 0;
+		uint64_t size = 0;
+		/* The modification time, in nanoseconds since the epoch. */
+		int64_t mtime_ns = 0;
+
+		bool operator ==(const FileStamp & other) const
+		{
+			return device == other.device && inode == other.inode && size == other.size && mtime_ns == other.mtime_ns;
+		}
+		bool operator !=(const FileStamp & other) const { return !(* this == other); }
+
+		/* Returns the current stamp of a file; an all-zero stamp (which never matches a real file) if the file can not be examined. */
+		static FileStamp of(const QString & fileName)
+		{
+			FileStamp stamp;
+#ifdef Q_OS_UNIX
+			struct stat st;
+			if (stat(fileName.toLocal8Bit().constData(), & st))
+				return stamp;
+			stamp.device = st.st_dev;
+			stamp.inode = st.st_ino;
+			stamp.size = st.st_size;
+#ifdef Q_OS_DARWIN
+			stamp.mtime_ns = (int64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+			stamp.mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#else
+			QFileInfo fi(fileName);
+			if (!fi.exists())
+				return stamp;
+			stamp.size = fi.size();
+			stamp.mtime_ns = fi.lastModified().toMSecsSinceEpoch() * 1000000;
+#endif
+			return stamp;
+		}
+	};
+	struct Entry
+	{
+		uint64_t piece_length = 0;
+		/* The stamps of all data files of the torrent, in torrent order. */
+		std::vector<FileStamp> files;
+		/* For each piece, true if the piece was verified successfully. */
+		std::vector<bool> verified_pieces;
+	};
+private:
+	static constexpr char MAGIC[8] = { 'T', 'F', 'P', 'V', 'C', 'A', 'C', '1' };
+	const QString directory;
+
+	QString entryFileName(const QByteArray & info_hash) const { return directory + '/' + info_hash.toHex(); }
+public:
+	VerificationCache(const QString & directory) : directory(directory) {}
+
+	static QString defaultDirectory(void) { return QStandardPaths::writableLocation(QStandardPaths::CacheLocation); }
+	const QString & path(void) const { return directory; }
+
+	/* Loads the entry for a torrent. Returns false if there is no entry, or if the entry does not match the expected
+	 * torrent geometry - in which case there is nothing to reuse. */
+	bool load(const QByteArray & info_hash, uint64_t piece_length, int64_t piece_count, int file_count, Entry & entry) const
+	{
+		QFile f(entryFileName(info_hash));
+		if (!f.open(QFile::ReadOnly))
+			return false;
+		const QByteArray data = f.readAll();
+		const size_t header_size = sizeof MAGIC + 3 * sizeof(uint64_t);
+		const size_t expected_size = header_size + file_count * sizeof(FileStamp) + (piece_count + 7) / 8;
+		if ((size_t) data.size() != expected_size || memcmp(data.constData(), MAGIC, sizeof MAGIC))
+			return false;
+		uint64_t header[3];
+		memcpy(header, data.constData() + sizeof MAGIC, sizeof header);
+		if (header[0] != piece_length || header[1] != (uint64_t) piece_count || header[2] != (uint64_t) file_count)
+			return false;
+
+		entry.piece_length = piece_length;
+		entry.files.resize(file_count);
+		memcpy(entry.files.data(), data.constData() + header_size, file_count * sizeof(FileStamp));
+		const uchar * bitmap = reinterpret_cast<const uchar *>(data.constData()) + header_size + file_count * sizeof(FileStamp);
+		entry.verified_pieces.resize(piece_count);
+		for (int64_t i = 0; i < piece_count; i ++)
+			entry.verified_pieces[i] = bitmap[i / 8] & (1 << (i % 8));
+		return true;
+	}
+	bool store(const QByteArray & info_hash, const Entry & entry) const
+	{
+		if (!QDir().mkpath(directory))
+		{
+			qCritical() << "Can not create the verification cache directory:" << directory;
+			return false;
+		}
+		QByteArray data(MAGIC, sizeof MAGIC);
+		const uint64_t header[3] = { entry.piece_length, entry.verified_pieces.size(), entry.files.size() };
+		data.append(reinterpret_cast<const char *>(header), sizeof header);
+		data.append(reinterpret_cast<const char *>(entry.files.data()), entry.files.size() * sizeof(FileStamp));
+		QByteArray bitmap((entry.verified_pieces.size() + 7) / 8, 0);
+		for (size_t i = 0; i < entry.verified_pieces.size(); i ++)
+			if (entry.verified_pieces[i])
+				bitmap[(int) (i / 8)] = bitmap.at(i / 8) | (1 << (i % 8));
+		data.append(bitmap);
+
+		QSaveFile f(entryFileName(info_hash));
+		if (!f.open(QFile::WriteOnly) || f.write(data) != data.size() || !f.commit())
+		{
+			qCritical() << "Can not write the verification cache file:" << f.fileName();
+			return false;
+		}
+		return true;
+	}
+};
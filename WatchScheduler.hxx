@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+/* Schedules the verification work of the watch mode, in order of priority.
+ *
+ * Changed data comes first - the pieces of data files which have been written to are queued per torrent, and are
+ * verified once no more changes have been seen for the torrent for 'SETTLE_MS' milliseconds, so that a file which is
+ * being written to in bursts is only verified once the burst is over. Periodic background re-scrubs of whole torrents
+ * come last. The scrubs are split into chunks of 'SCRUB_CHUNK_PIECES' pieces, so that changed data never waits long
+ * for a scrub of a large torrent to finish.
+ *
+ * Torrents are identified by their index in the list of torrents. Torrents with a piece count of 0 - which can not be
+ * verified piece by piece - are always verified as a whole, in a single job. */
+class WatchScheduler
+{
+public:
+	enum
+	{
+		SETTLE_MS		= 2000,
+		SCRUB_CHUNK_PIECES	= 1024,
+	};
+	enum Priority
+	{
+		CHANGED_DATA,
+		SCRUB,
+	};
+	struct Job
+	{
+		int torrent_index = -1;
+		Priority priority = CHANGED_DATA;
+		/* The pieces to verify, in piece order; empty - the whole torrent. */
+		std::vector<int64_t> pieces;
+	};
+private:
+	const std::vector<int64_t> piece_counts;
+	struct Change
+	{
+		std::set<int64_t> pieces;
+		int64_t last_change_ms;
+	};
+	std::map<int, Change> changes;
+	struct Scrub
+	{
+		int torrent_index;
+		int64_t next_piece;
+	};
+	std::deque<Scrub> scrubs;
+public:
+	WatchScheduler(const std::vector<int64_t> & piece_counts) : piece_counts(piece_counts) {}
+
+	/* Queues the pieces 'first_piece' to 'last_piece' of a torrent, which have changed at 'now_ms'. */
+	void changed(int torrent_index, int64_t first_piece, int64_t last_piece, int64_t now_ms)
+	{
+		Change & change = changes[torrent_index];
+		for (int64_t piece_index = first_piece; piece_index <= last_piece && piece_index < piece_counts.at(torrent_index); piece_index ++)
+			change.pieces.insert(piece_index);
+		change.last_change_ms = now_ms;
+	}
+	/* Queues a scrub of all torrents, which are not being scrubbed already. */
+	void scrubAll(void)
+	{
+		std::vector<bool> queued(piece_counts.size(), false);
+		for (const auto & s : scrubs)
+			queued[s.torrent_index] = true;
+		for (size_t i = 0; i < piece_counts.size(); i ++)
+			if (!queued.at(i))
+				scrubs.push_back(Scrub { (int) i, 0 });
+	}
+	bool scrubbing(void) const { return scrubs.size(); }
+
+	/* Returns the number of milliseconds until the next job is due, or -1 if there are no jobs. */
+	int64_t nextDueMs(int64_t now_ms) const
+	{
+		if (scrubs.size())
+			return 0;
+		int64_t due = -1;
+		for (const auto & c : changes)
+		{
+			const int64_t d = std::max(c.second.last_change_ms + SETTLE_MS - now_ms, (int64_t) 0);
+			due = due == -1 ? d : std::min(due, d);
+		}
+		return due;
+	}
+	/* Takes the next job, which is due. Returns false if there is none. */
+	bool next(int64_t now_ms, Job & job)
+	{
+		/* The changed data, which has settled for the longest time, first. */
+		auto settled = changes.end();
+		for (auto c = changes.begin(); c != changes.end(); c ++)
+			if (now_ms - c->second.last_change_ms >= SETTLE_MS && (settled == changes.end() || c->second.last_change_ms < settled->second.last_change_ms))
+				settled = c;
+		if (settled != changes.end())
+		{
+			job.torrent_index = settled->first;
+			job.priority = CHANGED_DATA;
+			job.pieces.assign(settled->second.pieces.begin(), settled->second.pieces.end());
+			changes.erase(settled);
+			return true;
+		}
+		if (!scrubs.size())
+			return false;
+		Scrub & scrub = scrubs.front();
+		const int64_t piece_count = piece_counts.at(scrub.torrent_index);
+		job.torrent_index = scrub.torrent_index;
+		job.priority = SCRUB;
+		job.pieces.clear();
+		for (int64_t piece_index = scrub.next_piece; piece_index < std::min(scrub.next_piece + SCRUB_CHUNK_PIECES, piece_count); piece_index ++)
+			job.pieces.push_back(piece_index);
+		scrub.next_piece += SCRUB_CHUNK_PIECES;
+		if (scrub.next_piece >= piece_count)
+			scrubs.pop_front();
+		return true;
+	}
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+#include <cstdint>
+#include <vector>
+
+#include "Bencode.hxx"
+
+/* A bencoded document, parsed in a single pass into a flat 'tape' of nodes. The verifier reads the torrent files
+ * with 'BencodeReader' directly, the tape is only kept for comparison in the bencode benchmark.
+ *
+ * The nodes are stored in one array, in document order - a list or dictionary node is immediately followed by its
+ * descendants, and each node records the index of the node that follows its last descendant, so whole subtrees can be
+ * skipped in constant time. Dictionary children alternate between key and value nodes. Strings are not copied, string nodes
+ * refer to the string data in the (implicitly shared) document buffer. All offsets are 64 bit. */
+class BencodeDocument
+{
+public:
+	typedef Bencode::NodeType NodeType;
+	/* Returned by 'find()' when a dictionary does not contain a key. */
+	static constexpr size_t NONE = SIZE_MAX;
+
+	struct Node
+	{
+		NodeType type;
+		/* For integers - the value; for lists and dictionaries - the number of child nodes (keys and values both count). */
+		int64_t value;
+		/* The span of the node in the document. For strings, this is the span of the string data, without the length prefix;
+		 * for lists and dictionaries, this is the span of the complete encoding, including all descendants. */
+		uint64_t begin, end;
+		/* The index of the node, which follows this node and all of its descendants. */
+		uint64_t next;
+	};
+private:
+	QByteArray data;
+	std::vector<Node> tape;
+
+	/* Appends the nodes to the tape, as they are reported by the reader. */
+	struct TapeBuilder
+	{
+		std::vector<Node> & tape;
+		/* The tape indices of the currently open lists and dictionaries. */
+		std::vector<uint64_t> open;
+
+		bool add(NodeType type, int64_t value, uint64_t begin, uint64_t end)
+		{
+			if (open.size())
+				tape.at(open.back()).value ++;
+			tape.push_back(Node { type, value, begin, end, tape.size() + 1 });
+			return true;
+		}
+		bool beginList(uint64_t begin) { add(Bencode::LIST, 0, begin, 0); open.push_back(tape.size() - 1); return true; }
+		bool beginDictionary(uint64_t begin) { add(Bencode::DICTIONARY, 0, begin, 0); open.push_back(tape.size() - 1); return true; }
+		bool end(uint64_t end)
+		{
+			Node & container = tape.at(open.back());
+			container.end = end;
+			container.next = tape.size();
+			open.pop_back();
+			return true;
+		}
+		bool key(QByteArrayView key, uint64_t begin) { return add(Bencode::STRING, 0, begin, begin + key.size()); }
+		bool string(QByteArrayView s, uint64_t begin) { return add(Bencode::STRING, 0, begin, begin + s.size()); }
+		bool integer(int64_t i, uint64_t begin, uint64_t end) { return add(Bencode::INTEGER, i, begin, end); }
+	};
+public:
+	/* Parses a complete document, which must consist of a single value. Data past the end of the value is ignored. */
+	bool parse(const QByteArray & document)
+	{
+		data = document;
+		tape.clear();
+		/* A rough estimate, to avoid most reallocations. */
+		tape.reserve(data.size() / 16 + 1);
+		TapeBuilder builder { tape, {} };
+		if (!BencodeReader<TapeBuilder>::parse(data, builder))
+		{
+			tape.clear();
+			return false;
+		}
+		return true;
+	}
+
+	const QByteArray & bytes(void) const { return data; }
+	size_t nodeCount(void) const { return tape.size(); }
+	/* The root node is always at index 0. */
+	const Node & node(size_t index) const { return tape.at(index); }
+	NodeType type(size_t index) const { return tape.at(index).type; }
+	bool isString(size_t index) const { return index < tape.size() && tape.at(index).type == Bencode::STRING; }
+	bool isInteger(size_t index) const { return index < tape.size() && tape.at(index).type == Bencode::INTEGER; }
+	bool isList(size_t index) const { return index < tape.size() && tape.at(index).type == Bencode::LIST; }
+	bool isDictionary(size_t index) const { return index < tape.size() && tape.at(index).type == Bencode::DICTIONARY; }
+
+	int64_t integer(size_t index) const { return tape.at(index).value; }
+	/* The string data, which points into the document buffer. */
+	QByteArrayView string(size_t index) const { return span(index); }
+	/* The span of the node in the document buffer - see 'Node' above. */
+	QByteArrayView span(size_t index) const
+	{
+		const Node & n = tape.at(index);
+		return QByteArrayView(data.constData() + n.begin, n.end - n.begin);
+	}
+
+	/* Calls 'f(index)' for each child of a list. */
+	template <typename F> void forEachElement(size_t list, F f) const
+	{
+		for (size_t i = list + 1; i < tape.at(list).next; i = tape.at(i).next)
+			f(i);
+	}
+	/* Calls 'f(key, value_index)' for each item of a dictionary, in document order. */
+	template <typename F> void forEachItem(size_t dictionary, F f) const
+	{
+		for (size_t i = dictionary + 1; i < tape.at(dictionary).next; i = tape.at(i + 1).next)
+			f(string(i), i + 1);
+	}
+	/* Returns the index of the value for a key in a dictionary, or NONE if the key is not present. */
+	size_t find(size_t dictionary, const char * key) const
+	{
+		for (size_t i = dictionary + 1; i < tape.at(dictionary).next; i = tape.at(i + 1).next)
+			if (Bencode::equals(string(i), key))
+				return i + 1;
+		return NONE;
+	}
+};
@@ -0,0 +1,518 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include <functional>
+#include <random>
+
+#include "Bencode.hxx"
+#include "BencodeDocument.hxx"
+#include "BitTorrent.hxx"
+#include "PieceReader.hxx"
+#include "ReadEngine.hxx"
+#include "Sha1.hxx"
+#include "TorrentVerifier.hxx"
+
+/* Benchmarks for the torrent data verifier, on synthetic torrents.
+ *
+ * The generator writes a data tree of pseudo-random files, and a matching .torrent file. The file sizes follow
+ * a configurable distribution, and are not multiples of the piece length, unless requested otherwise, so many pieces
+ * straddle file boundaries - as in real torrents. The generated data is then used by the benchmarks:
+ *
+ *	bencode	- parsing the torrent file: the event-driven reader, the node tape, and the complete torrent parser
+ *	hash	- hashing pieces in memory, with each SHA1 kernel supported by the processor
+ *	read	- reading all pieces, with each read engine, without hashing
+ *	verify	- complete verification with 'verify_torrent_hashes()', for the read engines and hashing thread counts requested
+ *
+ * Each measurement is repeated, and the best time is reported. Note that the read and verify benchmarks mostly read
+ * from the page cache, unless the data is larger than the memory, or '--cold' is specified. */
+
+struct GeneratorOptions
+{
+	unsigned	file_count = 64;
+	/* The mean file size. */
+	uint64_t	file_size = 4 << 20;
+	/* The file size distribution - 'fixed', 'uniform' (up to twice the mean size), or 'exponential'. */
+	QString		distribution = "exponential";
+	uint64_t	piece_length = 256 << 10;
+	/* Round all file sizes up to a multiple of the piece length, so that no piece straddles a file boundary. */
+	bool		aligned = false;
+	unsigned	seed = 1;
+};
+
+static QByteArray bencodeString(const QByteArray & s) { return QByteArray::number(s.size()) + ':' + s; }
+static QByteArray bencodeInteger(int64_t i) { return 'i' + QByteArray::number((qint64) i) + 'e'; }
+
+/* Generates the data tree '<directory>/data/<name>', and the torrent file '<directory>/<name>.torrent'.
+ * Returns the torrent file name, or an empty string on error. */
+static QString generateTorrent(const QString & directory, const QString & name, const GeneratorOptions & options)
+{
+	std::mt19937_64 random(options.seed);
+	std::function<uint64_t(void)> fileSize = [&] (void) -> uint64_t {
+		uint64_t size = options.file_size;
+		if (options.distribution == "uniform")
+			size = std::uniform_int_distribution<uint64_t>(0, 2 * options.file_size)(random);
+		else if (options.distribution == "exponential")
+			size = std::exponential_distribution<double>(1. / std::max<uint64_t>(options.file_size, 1))(random);
+		if (options.aligned)
+			size = (size + options.piece_length - 1) / options.piece_length * options.piece_length;
+		return size;
+	};
+
+	QByteArray files, pieces, piece;
+	QByteArray chunk(1 << 20, 0);
+	uint64_t state = options.seed * 0x9e3779b97f4a7c15ull + 1;
+	for (unsigned i = 0; i < options.file_count; i ++)
+	{
+		/* At most 100 files in a directory. */
+		const QStringList path = QStringList() << QString("dir%1").arg(i / 100) << QString("file%1.bin").arg(i);
+		const QString fileName = directory + "/data/" + name + '/' + path.join('/');
+		QDir().mkpath(QFileInfo(fileName).path());
+		QFile f(fileName);
+		if (!f.open(QFile::WriteOnly | QFile::Truncate))
+		{
+			qCritical() << "Can not create file:" << fileName;
+			return QString();
+		}
+		const uint64_t size = fileSize();
+		for (uint64_t written = 0; written < size; )
+		{
+			/* xorshift64, pseudo-random data does not compress, and does not deduplicate. */
+			for (qsizetype x = 0; x < chunk.size(); x += sizeof state)
+			{
+				state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+				memcpy(chunk.data() + x, & state, sizeof state);
+			}
+			const qint64 length = std::min<uint64_t>(chunk.size(), size - written);
+			if (f.write(chunk.constData(), length) != length)
+			{
+				qCritical() << "Error writing file:" << fileName;
+				return QString();
+			}
+			written += length;
+			/* Hash the data stream in pieces, across file boundaries. */
+			for (qint64 x = 0; x < length; )
+			{
+				const qint64 n = std::min<qint64>(options.piece_length - piece.size(), length - x);
+				piece.append(chunk.constData() + x, n);
+				x += n;
+				if ((uint64_t) piece.size() == options.piece_length)
+				{
+					pieces += Sha1::hash(piece);
+					piece.clear();
+				}
+			}
+		}
+		files += 'd' + bencodeString("length") + bencodeInteger(size) + bencodeString("path") + 'l';
+		for (const auto & p : path)
+			files += bencodeString(p.toUtf8());
+		files += "ee";
+	}
+	if (piece.size())
+		pieces += Sha1::hash(piece);
+
+	const QByteArray torrent = 'd' + bencodeString("announce") + bencodeString("http://localhost/announce")
+			+ bencodeString("info") + 'd' + bencodeString("files") + 'l' + files + 'e'
+			+ bencodeString("name") + bencodeString(name.toUtf8())
+			+ bencodeString("piece length") + bencodeInteger(options.piece_length)
+			+ bencodeString("pieces") + bencodeString(pieces) + "ee";
+	const QString torrentFileName = directory + '/' + name + ".torrent";
+	QFile f(torrentFileName);
+	if (!f.open(QFile::WriteOnly | QFile::Truncate) || f.write(torrent) != torrent.size())
+	{
+		qCritical() << "Can not write torrent file:" << torrentFileName;
+		return QString();
+	}
+	return torrentFileName;
+}
+
+/* Runs 'f()' 'iterations' times, and returns the best time, in seconds. If specified, 'prepare()' is called
+ * before each run, and is not timed. */
+static double bestTime(unsigned iterations, const std::function<void(void)> & f, const std::function<void(void)> & prepare = nullptr)
+{
+	double best = 0;
+	for (unsigned i = 0; i < std::max(iterations, 1u); i ++)
+	{
+		if (prepare)
+			prepare();
+		QElapsedTimer timer;
+		timer.start();
+		f();
+		const double seconds = timer.nsecsElapsed() / 1e9;
+		if (!i || seconds < best)
+			best = seconds;
+	}
+	return std::max(best, 1e-9);
+}
+
+static void report(const QString & benchmark, const QString & variant, uint64_t bytes, double seconds, uint64_t items, const char * unit)
+{
+	qInfo().noquote() << QString("%1 %2 %3 MB/s %4 %5/s")
+			     .arg(benchmark, -8).arg(variant, -40)
+			     .arg((double) bytes / seconds / (1 << 20), 10, 'f', 1)
+			     .arg((double) items / seconds, 12, 'f', 1).arg(unit);
+}
+
+/* Returns the names of the data files of a (multi-file) torrent, and optionally their sizes. */
+static QStringList dataFileNames(const BitTorrent & torrent, const QString & dataDirectory, QList<uint64_t> * fileSizes = 0)
+{
+	QStringList fileNames;
+	for (const auto & f : torrent.torrent_details.files)
+	{
+		fileNames << dataDirectory + '/' + torrent.torrent_details.name + '/' + f.path.join('/');
+		if (fileSizes)
+			* fileSizes << f.length;
+	}
+	return fileNames;
+}
+
+/* Drops the data files from the page cache, so that they are read from the storage device again. */
+static void dropPageCache(const QStringList & fileNames)
+{
+	for (const auto & f : fileNames)
+	{
+		DataFile file(f);
+		if (file.open(false))
+			file.dropCache(0, QFileInfo(f).size());
+	}
+}
+
+/* Drops messages, while the functions under test are running. */
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext & context, const QString & message)
+{
+	Q_UNUSED(context)
+	if (type != QtInfoMsg && type != QtDebugMsg)
+		fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+/* Accepts any bencoded document, and does nothing - to measure the reader alone. */
+struct NullHandler
+{
+	uint64_t count = 0;
+	bool beginList(uint64_t) { count ++; return true; }
+	bool beginDictionary(uint64_t) { count ++; return true; }
+	bool end(uint64_t) { return true; }
+	bool key(QByteArrayView, uint64_t) { count ++; return true; }
+	bool string(QByteArrayView, uint64_t) { count ++; return true; }
+	bool integer(int64_t, uint64_t, uint64_t) { count ++; return true; }
+};
+
+static void benchmarkBencode(const QString & torrentFileName, unsigned iterations)
+{
+	QFile f(torrentFileName);
+	if (!f.open(QFile::ReadOnly))
+		return;
+	const QByteArray data = f.readAll();
+	/* Parse small torrents repeatedly, to get measurable times. */
+	const unsigned repeat = std::max<qsizetype>(1, (64 << 20) / std::max<qsizetype>(data.size(), 1));
+	const uint64_t bytes = (uint64_t) data.size() * repeat;
+
+	double seconds = bestTime(iterations, [&] (void) -> void {
+		for (unsigned i = 0; i < repeat; i ++)
+		{
+			NullHandler handler;
+			BencodeReader<NullHandler>::parse(data, handler);
+		}
+	});
+	report("bencode", "reader", bytes, seconds, repeat, "parses");
+
+	seconds = bestTime(iterations, [&] (void) -> void {
+		for (unsigned i = 0; i < repeat; i ++)
+		{
+			BencodeDocument document;
+			document.parse(data);
+		}
+	});
+	report("bencode", "document", bytes, seconds, repeat, "parses");
+
+	seconds = bestTime(iterations, [&] (void) -> void {
+		for (unsigned i = 0; i < repeat; i ++)
+		{
+			BitTorrent t(torrentFileName);
+			t.parse();
+		}
+	});
+	report("bencode", "torrent (streaming, with info-hash)", bytes, seconds, repeat, "parses");
+}
+
+static void benchmarkHash(uint64_t piece_length, unsigned iterations)
+{
+	/* Enough pieces to keep all lanes of a multi-buffer kernel busy, and to get measurable times. */
+	const unsigned piece_count = std::max<uint64_t>(Sha1::MAX_LANES, (256 << 20) / piece_length);
+	std::vector<QByteArray> pieces(Sha1::MAX_LANES);
+	for (unsigned i = 0; i < pieces.size(); i ++)
+		pieces.at(i) = QByteArray(piece_length, 'a' + i);
+	std::vector<Sha1::Segments> messages;
+	for (const auto & p : pieces)
+		messages.push_back(Sha1::Segments { QByteArrayView(p) });
+	const uint64_t bytes = piece_length * piece_count;
+
+	for (const auto & kernel : Sha1::kernelNames())
+	{
+		Sha1::selectKernel(kernel);
+		double seconds = bestTime(iterations, [&] (void) -> void {
+			for (unsigned i = 0; i < piece_count; i ++)
+				Sha1::hash(messages.at(i % messages.size()));
+		});
+		report("hash", kernel, bytes, seconds, piece_count, "pieces");
+		if (Sha1::isMultiBuffer())
+		{
+			std::vector<const Sha1::Segments *> batch;
+			for (const auto & m : messages)
+				batch.push_back(& m);
+			seconds = bestTime(iterations, [&] (void) -> void {
+				for (unsigned i = 0; i < piece_count; i += batch.size())
+					Sha1::hashMultiBuffer(batch);
+			});
+			report("hash", kernel + " (multi-buffer)", bytes, seconds, piece_count, "pieces");
+		}
+	}
+}
+
+/* Reads all pieces of a torrent, in batches of the read engine queue depth, as the verification does, without hashing. */
+static void benchmarkRead(const BitTorrent & torrent, const QString & dataDirectory, const QStringList & engines,
+		unsigned queue_depth, bool cold, unsigned iterations)
+{
+	QList<uint64_t> fileSizes;
+	const QStringList fileNames = dataFileNames(torrent, dataDirectory, & fileSizes);
+	const TorrentDataLayout layout(fileNames, fileSizes, torrent.torrent_details.piece_length);
+
+	for (const auto & engineName : engines)
+	{
+		std::unique_ptr<ReadEngine> engine = ReadEngine::create(engineName, queue_depth, false);
+		std::vector<std::unique_ptr<DataFile>> files;
+		for (const auto & f : fileNames)
+		{
+			files.push_back(std::make_unique<DataFile>(f));
+			if (!files.back()->open(false))
+			{
+				qCritical() << "Could not open file for reading:" << f;
+				return;
+			}
+		}
+		PieceBufferPool buffers(layout.pieceLength(), engine->queueDepth());
+		const double seconds = bestTime(iterations, [&] (void) -> void {
+			for (int64_t first_piece = 0; first_piece < layout.pieceCount(); first_piece += engine->queueDepth())
+			{
+				std::vector<std::shared_ptr<char>> batch;
+				std::vector<ReadRequest> requests;
+				for (int64_t piece_index = first_piece; piece_index < std::min<int64_t>(first_piece + engine->queueDepth(), layout.pieceCount()); piece_index ++)
+				{
+					batch.push_back(buffers.acquire());
+					uint64_t buffer_offset = 0;
+					for (const auto & segment : layout.pieceSegments(piece_index))
+					{
+						requests.push_back(ReadRequest { files.at(segment.file_index).get(), segment.file_offset, batch.back().get() + buffer_offset, segment.length });
+						buffer_offset += segment.length;
+					}
+				}
+				if (!engine->read(requests))
+					qCritical() << "Read error, engine:" << engineName;
+			}
+		}, [&] (void) -> void {
+			if (cold)
+				dropPageCache(fileNames);
+		});
+		report("read", QString("%1, depth %2").arg(engine->name()).arg(engine->queueDepth()), layout.totalLength(), seconds, layout.pieceCount(), "pieces");
+	}
+}
+
+static void benchmarkVerify(const QString & torrentFileName, const QString & dataDirectory, const QStringList & engines,
+		const QList<unsigned> & threadCounts, unsigned queue_depth, bool cold, unsigned iterations)
+{
+	BitTorrent torrent(torrentFileName);
+	if (!torrent.parse())
+		return;
+	uint64_t total_length = 0;
+	for (const auto & f : torrent.torrent_details.files)
+		total_length += f.length;
+	const QStringList fileNames = dataFileNames(torrent, dataDirectory);
+
+	/* Also verify memory-mapped files. */
+	const QStringList variants = QStringList(engines) << "mmap";
+	for (const auto & engineName : variants)
+		for (const auto threads : threadCounts)
+		{
+			VerificationOptions options;
+			options.memory_map_files = engineName == "mmap";
+			options.io_engine = options.memory_map_files ? "sync" : engineName;
+			options.io_queue_depth = queue_depth;
+			options.hash_thread_count = threads;
+			options.drop_cache = cold;
+			bool ok = true;
+			qInstallMessageHandler(quietMessageHandler);
+			const double seconds = bestTime(iterations, [&] (void) -> void {
+				TorrentCheckResult result(torrentFileName);
+				ok &= verify_torrent_hashes(dataDirectory, torrent, options, result);
+			}, [&] (void) -> void {
+				if (cold)
+					dropPageCache(fileNames);
+			});
+			/* Restore the default handler. */
+			qInstallMessageHandler(0);
+			if (!ok)
+				qCritical() << "Verification failed, engine:" << engineName << ", threads:" << threads;
+			report("verify", QString("%1, %2 threads, SHA1 %3").arg(engineName).arg(threads).arg(Sha1::kernelName()),
+					total_length, seconds, torrent.pieceCount(), "pieces");
+		}
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication application(argc, argv);
+	application.setApplicationName("torrent-data-verifier-benchmark");
+
+	std::function<void(void)> printUsage = [] (void) -> void {
+		qInfo() << "Torrent data verifier benchmarks.";
+		qInfo() << "Generates a synthetic torrent and data tree, and measures the parsing, hashing, reading and verification speeds.";
+		qInfo() << "";
+		qInfo() << "Usage:";
+		qInfo() << "torrent-data-verifier-benchmark [-h] [--work-dir DIR] [--no-generate] [--generate-only] [--files N] [--file-size BYTES]";
+		qInfo() << "		[--distribution DISTRIBUTION] [--piece-length BYTES] [--aligned] [--seed N] [--benchmarks LIST]";
+		qInfo() << "		[--iterations N] [--io-engines LIST] [--io-depth N] [--threads LIST] [--sha1-kernel KERNEL] [--cold]";
+		qInfo() << "";
+		qInfo() << "Options:";
+		qInfo() << "-h | --help		Print this usage information.";
+		qInfo() << "--work-dir DIR		The directory for the generated torrent and data (default 'benchmark-data').";
+		qInfo() << "--no-generate		Use the torrent and data generated by a previous run.";
+		qInfo() << "--generate-only		Only generate the torrent and data, do not run any benchmarks.";
+		qInfo() << "--files N		The number of files in the torrent (default 64).";
+		qInfo() << "--file-size BYTES	The mean file size (default 4 MiB).";
+		qInfo() << "--distribution DISTRIBUTION	The file size distribution, 'fixed', 'uniform' or 'exponential' (the default).";
+		qInfo() << "--piece-length BYTES	The piece length (default 256 KiB).";
+		qInfo() << "--aligned		Round file sizes up to multiples of the piece length, so that no piece straddles files.";
+		qInfo() << "--seed N		The seed of the pseudo-random file sizes and data (default 1).";
+		qInfo() << "--benchmarks LIST	A comma-separated list of the benchmarks to run (default 'bencode,hash,read,verify').";
+		qInfo() << "--iterations N		Repeat each measurement N times, and report the best time (default 3).";
+		qInfo().noquote() << "--io-engines LIST	The read engines to measure (default all, i.e." << ReadEngine::engineNames().join(",") + ").";
+		qInfo() << "			The verify benchmark also measures memory-mapped files.";
+		qInfo() << "--io-depth N		The number of reads kept in flight by the 'pread' and 'uring' read engines (default 4).";
+		qInfo() << "--threads LIST		The numbers of hashing threads for the verify benchmark (default '0,N', N = processor count).";
+		qInfo() << "--sha1-kernel KERNEL	The SHA1 implementation for the verify benchmark (default 'auto').";
+		qInfo() << "--cold			Drop the data from the page cache before, and while reading it.";
+	};
+
+	QCommandLineParser cp;
+	QCommandLineOption helpOption(QStringList() << "h" << "help", "Print usage information.");
+	cp.addOption(helpOption);
+	QCommandLineOption workDirOption(QStringList() << "work-dir", "The directory for the generated data.", "DIR", "benchmark-data");
+	cp.addOption(workDirOption);
+	QCommandLineOption noGenerateOption(QStringList() << "no-generate", "Use previously generated data.");
+	cp.addOption(noGenerateOption);
+	QCommandLineOption generateOnlyOption(QStringList() << "generate-only", "Only generate the data.");
+	cp.addOption(generateOnlyOption);
+	QCommandLineOption filesOption(QStringList() << "files", "The number of files.", "N", "64");
+	cp.addOption(filesOption);
+	QCommandLineOption fileSizeOption(QStringList() << "file-size", "The mean file size.", "BYTES", QString::number(4 << 20));
+	cp.addOption(fileSizeOption);
+	QCommandLineOption distributionOption(QStringList() << "distribution", "The file size distribution.", "DISTRIBUTION", "exponential");
+	cp.addOption(distributionOption);
+	QCommandLineOption pieceLengthOption(QStringList() << "piece-length", "The piece length.", "BYTES", QString::number(256 << 10));
+	cp.addOption(pieceLengthOption);
+	QCommandLineOption alignedOption(QStringList() << "aligned", "Align the file sizes to the piece length.");
+	cp.addOption(alignedOption);
+	QCommandLineOption seedOption(QStringList() << "seed", "The pseudo-random seed.", "N", "1");
+	cp.addOption(seedOption);
+	QCommandLineOption benchmarksOption(QStringList() << "benchmarks", "The benchmarks to run.", "LIST", "bencode,hash,read,verify");
+	cp.addOption(benchmarksOption);
+	QCommandLineOption iterationsOption(QStringList() << "iterations", "The number of measurements.", "N", "3");
+	cp.addOption(iterationsOption);
+	QCommandLineOption ioEnginesOption(QStringList() << "io-engines", "The read engines to measure.", "LIST", ReadEngine::engineNames().join(","));
+	cp.addOption(ioEnginesOption);
+	QCommandLineOption ioDepthOption(QStringList() << "io-depth", "The read queue depth.", "N", "4");
+	cp.addOption(ioDepthOption);
+	QCommandLineOption threadsOption(QStringList() << "threads", "The numbers of hashing threads.", "LIST",
+			QString("0,%1").arg(std::max(std::thread::hardware_concurrency(), 1u)));
+	cp.addOption(threadsOption);
+	QCommandLineOption sha1KernelOption(QStringList() << "sha1-kernel", "The SHA1 implementation.", "KERNEL", "auto");
+	cp.addOption(sha1KernelOption);
+	QCommandLineOption coldOption(QStringList() << "cold", "Drop the data from the page cache.");
+	cp.addOption(coldOption);
+
+	cp.process(application);
+	if (cp.isSet(helpOption))
+	{
+		printUsage();
+		return 0;
+	}
+
+	GeneratorOptions generatorOptions;
+	bool ok, valid = true;
+	generatorOptions.file_count = cp.value(filesOption).toUInt(& ok);
+	valid &= ok && generatorOptions.file_count;
+	generatorOptions.file_size = cp.value(fileSizeOption).toULongLong(& ok);
+	valid &= ok;
+	generatorOptions.piece_length = cp.value(pieceLengthOption).toULongLong(& ok);
+	valid &= ok && generatorOptions.piece_length;
+	generatorOptions.seed = cp.value(seedOption).toUInt(& ok);
+	valid &= ok;
+	generatorOptions.distribution = cp.value(distributionOption);
+	valid &= QStringList({ "fixed", "uniform", "exponential" }).contains(generatorOptions.distribution);
+	generatorOptions.aligned = cp.isSet(alignedOption);
+	const unsigned iterations = cp.value(iterationsOption).toUInt(& ok);
+	valid &= ok && iterations;
+	const unsigned queueDepth = cp.value(ioDepthOption).toUInt(& ok);
+	valid &= ok && queueDepth;
+	QList<unsigned> threadCounts;
+	for (const auto & t : cp.value(threadsOption).split(','))
+	{
+		threadCounts << t.toUInt(& ok);
+		valid &= ok;
+	}
+	QStringList engines = cp.value(ioEnginesOption).split(',');
+	for (const auto & e : engines)
+		valid &= ReadEngine::engineNames().contains(e);
+	const QStringList benchmarks = cp.value(benchmarksOption).split(',');
+	for (const auto & b : benchmarks)
+		valid &= QStringList({ "bencode", "hash", "read", "verify" }).contains(b);
+	if (!valid)
+	{
+		qCritical() << "Invalid arguments.";
+		printUsage();
+		return 1;
+	}
+
+	const QString workDirectory = cp.value(workDirOption);
+	const QString name = "benchmark";
+	QString torrentFileName = workDirectory + '/' + name + ".torrent";
+	if (!cp.isSet(noGenerateOption))
+	{
+		qInfo().noquote() << QString("Generating %1 files (%2 distribution, mean size %3 bytes, piece length %4) in:")
+				     .arg(generatorOptions.file_count).arg(generatorOptions.distribution)
+				     .arg(generatorOptions.file_size).arg(generatorOptions.piece_length) << workDirectory;
+		QDir(workDirectory + "/data/" + name).removeRecursively();
+		if ((torrentFileName = generateTorrent(workDirectory, name, generatorOptions)).isEmpty())
+			return 1;
+	}
+	if (cp.isSet(generateOnlyOption))
+		return 0;
+
+	BitTorrent torrent(torrentFileName);
+	if (!torrent.parse())
+	{
+		qCritical() << "Failed to process file" << torrentFileName << "as a torrent file.";
+		return 1;
+	}
+	uint64_t total_length = 0;
+	for (const auto & f : torrent.torrent_details.files)
+		total_length += f.length;
+	qInfo().noquote() << QString("Torrent: %1 files, %2 bytes, %3 pieces of %4 bytes.")
+			     .arg(torrent.torrent_details.files.length()).arg(total_length).arg(torrent.pieceCount()).arg(torrent.torrent_details.piece_length);
+
+	if (benchmarks.contains("bencode"))
+		benchmarkBencode(torrentFileName, iterations);
+	if (benchmarks.contains("hash"))
+		benchmarkHash(torrent.torrent_details.piece_length, iterations);
+	if (!Sha1::selectKernel(cp.value(sha1KernelOption)))
+	{
+		qCritical() << "Unsupported SHA1 kernel specified:" << cp.value(sha1KernelOption);
+		return 1;
+	}
+	if (benchmarks.contains("read"))
+		benchmarkRead(torrent, workDirectory + "/data", engines, queueDepth, cp.isSet(coldOption), iterations);
+	if (benchmarks.contains("verify"))
+		benchmarkVerify(torrentFileName, workDirectory + "/data", engines, threadCounts, queueDepth, cp.isSet(coldOption), iterations);
+	return 0;
+}
@@ -0,0 +1,31 @@
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = torrent-file-processor-benchmark
+
+# The benchmarks use the header-only modules of the verifier directly.
+INCLUDEPATH += ..
+
+SOURCES += \
+        benchmark.cxx
+
+HEADERS += \
+    BencodeDocument.hxx \
+    ../Bencode.hxx \
+    ../BitTorrent.hxx \
+    ../CheckpointJournal.hxx \
+    ../FileSizeScanner.hxx \
+    ../MerkleTree.hxx \
+    ../Metrics.hxx \
+    ../PieceHashPipeline.hxx \
+    ../PieceReader.hxx \
+    ../PieceSampler.hxx \
+    ../ReadEngine.hxx \
+    ../ReadThrottle.hxx \
+    ../ResultStream.hxx \
+    ../Sha1.hxx \
+    ../TorrentScheduler.hxx \
+    ../TorrentVerifier.hxx \
+    ../VerificationCache.hxx
@@ -6,186 +6,30 @@
 #include <QElapsedTimer>
 #include <QCommandLineParser>
 #include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
 
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <unordered_map>
 
 #include "BitTorrent.hxx"
-
-
-enum
-{
-	MD5_HASH_STRING_LENGTH	= 32,
-};
-
-struct TorrentCheckResult
-{
-	QString		torrent_filename;
-	/* If any corrupted pieces are found in the torrent, when SHA1 checksums of data pieces in the torrent is performed,
-	 * this list will hold all affected files. */
-	QStringList	corrupted_files_by_sha1_checksum;
-	/* If MD5 checksumming of data for files which names *look* like an MD5 hash value is performed,
-	 * this list will hold any files that have been found to be corrupted when checking the MD5 hashes. */
-	QStringList	corrupted_files_by_md5_checksum;
-
-	TorrentCheckResult(const QString & torrent_filename) : torrent_filename(torrent_filename){}
-};
-
-static bool verify_torrent_hashes(const QString & torrentDataDirectoryName, const BitTorrent & bitTorrent,
-		bool verboseFlag, bool checkSizeOnlyFlag, bool computeMd5Hashes, struct TorrentCheckResult & checkResult)
-{
-	/* The list of files in the torrent piece currently verified - not including the currently processed file. */
-	QElapsedTimer timer;
-	timer.start();
-	QStringList current_piece_files_stack;
-	const uint64_t piece_length = bitTorrent.torrent_details.piece_length;
-	uint64_t total_length = 0;
-	QString h = bitTorrent.torrent_details.piece_sha1_hashes;
-	assert(h.length() % BitTorrent::SHA1_CHECKSUM_BYTESIZE == 0);
-	QStringList hashes;
-	do
-	{
-		hashes << h.left(BitTorrent::SHA1_CHECKSUM_BYTESIZE);
-		h.remove(0, BitTorrent::SHA1_CHECKSUM_BYTESIZE);
-	}
-	while (h.length());
-
-	/* Construct the list of filenames. */
-	QStringList fileNames;
-	QList<uint64_t> fileSizes;
-	if (!bitTorrent.torrent_details.files.length())
-	{
-		/* Single-file torrent. */
-		fileNames << torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name;
-		fileSizes << bitTorrent.torrent_details.length;
-	}
-	else
-	{
-		/* Multiple files in torrent. */
-		for (const auto & f : bitTorrent.torrent_details.files)
-		{
-			QString t(torrentDataDirectoryName + '/' + bitTorrent.torrent_details.name);
-			for (const auto & f : f.path)
-				t += '/' + f;
-			fileNames << t;
-			fileSizes << f.length;
-		}
-	}
-	QByteArray data;
-
-	std::function<bool(const QString & current_file)> verifyHash = [&] (const QString & current_file) -> bool {
-		bool result = true;
-		if (QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex().toLower() != hashes.front().toLower())
-		{
-			QString affectedFiles;
-			for (const auto & t : current_piece_files_stack)
-				affectedFiles += '"' + t + '"' + ", ";
-			affectedFiles += '"' + current_file + '"';
-			qCritical().noquote() << QCoreApplication::translate("Main", "ERROR: SHA1 hash mismatch, affected file(s) in the corrupted torrent piece:") << affectedFiles;
-			checkResult.corrupted_files_by_sha1_checksum << current_piece_files_stack;
-			result = false;
-		}
-		current_piece_files_stack.clear();
-		hashes.pop_front();
-		total_length += data.length();
-		data.clear();
-		return result;
-	};
-
-	bool result = true;
-	for (const auto & f : fileNames)
-	{
-		assert(data.length() < piece_length);
-		QFileInfo fi(f);
-		if (!fi.exists())
-		{
-			qCritical() << "File does not exist:" << f;
-			return false;
-		}
-		if (!fi.isFile())
-		{
-			qCritical() << "Invalid filename, not a file:" << f;
-			return false;
-		}
-		if (fi.size() != fileSizes.front())
-		{
-			qCritical() << "File size mismatch for file" << f << "Expected:" << fileSizes.front() << ", actual:" << fi.size();
-			return false;
-		}
-
-		if (!checkSizeOnlyFlag)
-		{
-			QFile file(f);
-			if (!file.open(QFile::ReadOnly))
-			{
-				qCritical() << "Could not open file for reading:" << f;
-				return false;
-			}
-
-			/* If a computation of md5 hash checksums is requested, and if the filename *looks* like an md5 hash value,
-			 * compute the md5 hash and compare it to the filename. */
-			/* Remove any file extensions. */
-			QString md5HashFromFilename = QFileInfo(f).fileName().split('.').at(0);
-			md5HashFromFilename = md5HashFromFilename.split('.').at(0);
-			bool md5Flag = (md5HashFromFilename.length() == MD5_HASH_STRING_LENGTH);
-			/* See if the filename looks like an md5 hash value. */
-			if (md5Flag)
-				for (const auto & c : md5HashFromFilename)
-					if (		   !('0' <= c && c <= '9')
-							&& !('a' <= c && c <= 'f')
-							&& !('A' <= c && c <= 'F')
-							)
-					{
-						md5Flag = false;
-						break;
-					}
-			md5Flag = computeMd5Hashes && md5Flag;
-			QCryptographicHash md5hash(QCryptographicHash::Md5);
-
-			while (!file.atEnd())
-			{
-				const QByteArray dataPiece = file.read(piece_length - data.length());
-				data += dataPiece;
-				if (data.length() == piece_length)
-					result &= verifyHash(f);
-				if (md5Flag)
-					md5hash.addData(dataPiece);
-			}
-			if (data.length())
-				current_piece_files_stack << f;
-			if (verboseFlag)
-			{
-				qInfo() << "Processed file" << f;
-				if (computeMd5Hashes)
-				{
-					if (md5Flag)
-						qInfo() << "Also computed the MD5 hash for file" << f;
-					else
-						qInfo() << "NOTE: requested computing the MD5 hash for file" << f << ", but filename not recognized as an MD5 hash value, did not compute MD5 hash value for this file.";
-				}
-			}
-			if (md5Flag && md5hash.result().toHex().toLower() != md5HashFromFilename)
-			{
-				result = false;
-				qCritical().noquote() << "ERROR: MD5 hash mismatch for file" << f;
-				qCritical().noquote() << "ERROR: expected MD5 hash:" << md5HashFromFilename.toLower() << "; computed MD5 hash:" << md5hash.result().toHex().toLower();
-				checkResult.corrupted_files_by_md5_checksum << f;
-			}
-
-		}
-
-		fileSizes.pop_front();
-	}
-	/* Handle last data piece. */
-	if (!checkSizeOnlyFlag && data.length() && !verifyHash(fileNames.last()))
-		result = false;
-
-	uint64_t milliseconds = timer.elapsed();
-	if (!checkSizeOnlyFlag)
-		qInfo().noquote() << QString("Average speed %2 megabytes/second.")
-				     .arg((((double) total_length / milliseconds) * 1000.) / (1 << 20));
-
-	return result;
-}
+#include "CheckpointJournal.hxx"
+#include "DataWatcher.hxx"
+#include "MetadataCatalog.hxx"
+#include "Metrics.hxx"
+#include "PartialResults.hxx"
+#include "ReadEngine.hxx"
+#include "ReadThrottle.hxx"
+#include "ResultStream.hxx"
+#include "ShardCoordinator.hxx"
+#include "Sha1.hxx"
+#include "TorrentCatalog.hxx"
+#include "TorrentScheduler.hxx"
+#include "TorrentVerifier.hxx"
+#include "VerificationCache.hxx"
+#include "WatchScheduler.hxx"
 
 int main(int argc, char *argv[])
 //int wmain(int argc, wchar_t *argv[])
@@ -199,23 +43,110 @@ int main(int argc, char *argv[])
 	if (0)
 	application.installTranslator(& translator);
 	uint64_t total_length = 0, total_file_count = 0, total_torrents_processed = 0;
+	/* For sample runs - the total number of pieces, of sampled pieces, and of corrupted pieces found in the samples. */
+	uint64_t total_piece_count = 0, total_sampled_pieces = 0, total_corrupted_sampled_pieces = 0;
 
 	std::function<void(void)> printUsage = [] (void) -> void {
 		qInfo() << "Torrent data verifier.";
 		qInfo() << "Verifies downloaded torrent files by computing the torrent SHA1 checksums.";
 		qInfo() << "";
 		qInfo() << "Usage:";
-		qInfo() << "libgen-torrent-data-verifier [-h] [-v] [-c] [-l] [-z] torrent-data-directory torrent-source";
+		qInfo() << "libgen-torrent-data-verifier [-h] [-v] [-c] [-l] [-z] [--build-catalog FILE] [--catalog FILE] [--owner-of PATH] [--scan-threads N] [-t N] [-j N] [--mmap] [--io-engine ENGINE] [--io-depth N] [--direct-io] [--drop-cache] [--max-read-rate MBPS] [--adaptive-io] [--target-latency MS] [--io-idle] [--sha1-kernel KERNEL] [--hash-version VERSION] [--self-test] [--full] [--sample SPEC] [--sample-seed N] [--cache-dir DIR] [--resume JOURNAL] [--watch] [--scrub-interval HOURS] [--coordinator ADDRESS] [--shard-pieces N] [--worker ADDRESS] [--partial-results FILE] [--merge FILE] [--json FILE] [--metrics TARGET] [--metrics-interval SECONDS] torrent-data-directory torrent-source";
 		qInfo() << "";
 		qInfo() << "Options:";
 		qInfo() << "-h | --help	Print this usage information.";
 		qInfo() << "-d | --dump	Only dump torrent file details, do not perform torrent data verification.";
+		qInfo() << "--dump-file FILE	Also dump the complete contents of the torrent files to FILE ('-' for the standard output).";
+		qInfo() << "--dump-format FORMAT	The format of the complete dump, 'text' (the default) or 'json' (one JSON object per torrent and line).";
+		qInfo() << "--build-catalog FILE	Only parse the torrent files, and write their metadata to the metadata catalog FILE.";
+		qInfo() << "			As with '-d', only a torrent source is specified. v2 torrents are not cataloged.";
+		qInfo() << "--catalog FILE		Load the metadata of the torrents from the metadata catalog FILE, instead of parsing the torrent files.";
+		qInfo() << "			Torrents which are not in the catalog, or which have changed since the catalog was built, are parsed.";
+		qInfo() << "--owner-of PATH		Print the torrent that holds the data file PATH (relative to the torrent data directory),";
+		qInfo() << "			as found in the metadata catalog specified with '--catalog', and exit. Can be specified more than once.";
 		qInfo() << "-v | --verbose	Turn on verbose reporting.";
 		qInfo() << "-c | --continue	Do not stop on errors, process all torrents specified.";
 		qInfo() << "-l | --torrent-list		The specified 'torrent-source' argument is a text file containing a list of torrent file names (separated by newlines) to be verified.";
 		qInfo() << "			If this flag is not specified, the 'torrent-source' argument is the name of a single torrent file to be verified.";
-		qInfo() << "-m | --md5		Also compute and check MD5 hash checksums for files with names which *look* like and MD5 hash value.";
+		qInfo() << "-m | --md5		Also compute and check MD5 hash checksums for files with names which *look* like and MD5 hash value,";
+		qInfo() << "			and for files with an 'md5sum' key in the torrent. The MD5 hashes are computed in a thread of their own.";
 		qInfo() << "-z | --check-size-only	Only check file sizes, and do not compute torrent checksums.";
+		qInfo() << "			The files of all torrents are checked up front, directory by directory, from a pool of threads.";
+		qInfo().noquote() << QString("--scan-threads N	The number of threads checking file sizes with '-z' (default %1).").arg((int) FileSizeScanner::DEFAULT_THREAD_COUNT);
+		qInfo() << "-t | --threads N	Compute the SHA1 checksums in N worker threads, while the data is being read.";
+		qInfo() << "			By default (N = 0), the checksums are computed in the data reading thread.";
+		qInfo() << "-j | --jobs N		Verify up to N torrents concurrently on each storage device holding torrent data.";
+		qInfo() << "			By default (N = 0), torrents are verified one after another.";
+		qInfo() << "			The results are always reported and logged in the order of the torrent list.";
+		qInfo() << "--mmap			Memory-map the torrent data files and hash the data in place, instead of reading the data into piece buffers.";
+		qInfo().noquote() << "--io-engine ENGINE	Select the data reading backend, one of:" << ReadEngine::engineNames().join(", ");
+		qInfo() << "			'sync' issues one blocking read at a time (the default), 'pread' issues blocking reads from a pool of threads,";
+		qInfo() << "			'uring' keeps several reads in flight with the Linux io_uring interface.";
+		qInfo() << "--io-depth N		The number of reads kept in flight by the 'pread' and 'uring' read engines (default 4).";
+		qInfo() << "--direct-io		Read the data with direct (O_DIRECT) reads, bypassing the page cache, whenever possible.";
+		qInfo() << "--drop-cache		Tell the kernel to drop the data from the page cache right after it has been read,";
+		qInfo() << "			so that verification does not evict the page cache of other services running on the host.";
+		qInfo() << "--max-read-rate MBPS	Limit the rate of reading the torrent data of all torrents together to MBPS megabytes/second,";
+		qInfo() << "			so that verification does not starve other services, which read from the same disks.";
+		qInfo() << "--adaptive-io		Limit the number of reads in flight adaptively: back off while the read latency is above the target";
+		qInfo() << "			latency, and ramp back up while the disks are mostly idle. The limit is bounded by '--io-depth' times '-j'.";
+		qInfo().noquote() << QString("--target-latency MS	The target read latency for '--adaptive-io', in milliseconds (default %1).").arg((int) ReadThrottle::DEFAULT_TARGET_LATENCY_MS);
+		qInfo() << "--io-idle		Read the data in the idle I/O scheduling class, which is only served when no other process uses the disk.";
+		qInfo() << "			Linux only, and only honored by the BFQ I/O scheduler.";
+		qInfo() << "			The time that the reads have waited because of these limits, summed over all reads, is reported as throttled time.";
+		qInfo().noquote() << "--sha1-kernel KERNEL	Select the SHA1 implementation, 'auto' (the default) or one of:" << Sha1::kernelNames().join(", ");
+		qInfo() << "			'auto' selects the fastest implementation supported by the processor. 'qt' is the Qt reference implementation,";
+		qInfo() << "			'shani' and 'armv8' use the x86 and ARMv8 SHA instructions, 'avx2' hashes up to 8 pieces at once";
+		qInfo() << "			in the worker threads (use together with '-t').";
+		qInfo() << "--hash-version VERSION	The hashes to verify the torrents with, 'auto' (the default), '1' or '2'. 'auto' verifies v2 and hybrid torrents";
+		qInfo() << "			with their SHA-256 Merkle tree (v2) hashes, and other torrents with their SHA1 (v1) hashes. '1' and '2' only verify";
+		qInfo() << "			torrents having hashes of that version. v2 torrents are verified one file per thread (see '-t').";
+		qInfo() << "			When only some pieces are verified ('--sample', '--watch' and sharded verification), hybrid torrents";
+		qInfo() << "			are verified with their v1 hashes. Torrents verified only with their v2 hashes can not be sampled,";
+		qInfo() << "			are always verified as a whole in watch mode and by a single worker, and resume ('--resume')";
+		qInfo() << "			at the start of the file that was being verified.";
+		qInfo() << "--self-test		Check all SHA1 implementations supported by the processor against the Qt reference implementation, and exit.";
+		qInfo() << "--full			Verify all data. By default, torrent pieces which have been verified by a previous run are skipped,";
+		qInfo() << "			if none of the files that they span have changed (same inode, size and modification time) since.";
+		qInfo() << "			Silent data corruption does not change the files, so do run a full verification from time to time.";
+		qInfo() << "--sample SPEC		Only verify a random sample of the pieces of each torrent, for a quick spot check of the torrent data.";
+		qInfo() << "			SPEC is either a percentage of the pieces (e.g. '2%'), or a number of pieces per torrent (e.g. '100').";
+		qInfo() << "			Pieces at file boundaries, and pieces of recently modified files, are more likely to be sampled.";
+		qInfo() << "			An upper bound of the rate of corrupted pieces (with 95 % confidence) is reported at the end.";
+		qInfo() << "			Can not be combined with '-m' or '-z'.";
+		qInfo() << "--sample-seed N		The seed for selecting the sampled pieces (default: based on the current time).";
+		qInfo() << "			The seed is reported, and the same seed selects the same pieces again.";
+		qInfo().noquote() << "--cache-dir DIR		The directory that holds the verification cache (default:" << VerificationCache::defaultDirectory() + ").";
+		qInfo() << "--resume JOURNAL	Resume an interrupted verification run, recorded in the specified checkpoint journal.";
+		qInfo() << "			Each run records its progress in a checkpoint journal (torrent-check-journal-*.txt). When resuming,";
+		qInfo() << "			the same torrent data directory and torrent source must be specified. Completed torrents are skipped,";
+		qInfo() << "			a torrent that was being verified is resumed near the point where verification stopped,";
+		qInfo() << "			and the results are reported as if the run had not been interrupted.";
+		qInfo() << "--watch			Keep running, and watch the torrent data directory for data files which have been written to.";
+		qInfo() << "			Only the pieces of the changed files are verified again, once the files have not changed for a while,";
+		qInfo() << "			and each result is logged as soon as it is available. Linux only. Can not be combined with '-d', '-z',";
+		qInfo() << "			'-j', '--sample' or '--resume'.";
+		qInfo() << "--scrub-interval HOURS	In watch mode, also verify all torrents in the background every HOURS hours (default 24, 0 - never).";
+		qInfo() << "			Changed data is always verified ahead of the background verification.";
+		qInfo() << "--coordinator ADDRESS	Verify the torrents with worker processes (see '--worker'), which may run on several hosts.";
+		qInfo() << "			The torrents are split into shards, which are handed out to the workers that connect to ADDRESS,";
+		qInfo() << "			either 'unix:PATH' for a Unix domain socket, or 'HOST:PORT' for a TCP socket. Once all shards";
+		qInfo() << "			have been verified, the partial result files of the workers are merged (see '--merge').";
+		qInfo() << "--shard-pieces N	Split torrents with more than N pieces into shards of N pieces (default 4096).";
+		qInfo() << "--worker ADDRESS	Verify the shards handed out by the coordinator at ADDRESS, and record their results in a partial";
+		qInfo() << "			result file. Workers must specify the same torrent data directory (at the same path, when the";
+		qInfo() << "			storage is shared between hosts), torrent source and '--hash-version' as the coordinator.";
+		qInfo() << "--partial-results FILE	The partial result file of a worker (default: torrent-check-partial-*.txt).";
+		qInfo() << "--merge FILE		Do not verify the torrents, but merge the results recorded in the partial result file FILE,";
+		qInfo() << "			which can be specified several times, into the results of the whole run.";
+		qInfo() << "			Sharded verification can not be combined with '-d', '-z', '-j', '--sample', '--resume' or '--watch'.";
+		qInfo() << "--json FILE		Also write the results in JSON lines format to FILE ('-' for the standard output),";
+		qInfo() << "			one record for each torrent, and one record for each corrupted piece.";
+		qInfo() << "--metrics TARGET	Periodically write performance metrics in Prometheus text format to TARGET, which is either";
+		qInfo() << "			a file name, or 'unix:PATH' to send the metrics to a listening Unix domain socket.";
+		qInfo() << "			The metrics include histograms of the time spent in each verification stage,";
+		qInfo() << "			e.g. waiting for data to be read versus hashing, to tell whether a run is disk-bound or CPU-bound.";
+		qInfo() << "--metrics-interval SECONDS	The interval between metrics dumps (default 10).";
 		qInfo() << "";
 		qInfo() << "A torrent data directory MUST always be specified.";
 		qInfo() << "Specify EITHER a text file containing the torrent files to be verified (with the '-l' switch), OR a single torrent file name.";
@@ -229,6 +160,10 @@ int main(int argc, char *argv[])
 		qInfo() << "";
 		qInfo() << "Verify the list of torrents contained in a text file:";
 		qInfo() << "libgen-torrent-data-verifier -l /torrents-data-directory/ torrent-list.txt";
+		qInfo() << "";
+		qInfo() << "Catalog the list of torrents once, and verify them without parsing the torrent files:";
+		qInfo() << "libgen-torrent-data-verifier -l --build-catalog torrents.catalog torrent-list.txt";
+		qInfo() << "libgen-torrent-data-verifier -l --catalog torrents.catalog /torrents-data-directory/ torrent-list.txt";
 	};
 
 	application.setApplicationName("torrent-data-verifier");
@@ -244,6 +179,12 @@ int main(int argc, char *argv[])
 	QCommandLineOption dumpOption(QStringList() << "d" << "dump", "Only dump torrent information, do not verify data");
 	cp.addOption(dumpOption);
 
+	QCommandLineOption dumpFileOption(QStringList() << "dump-file", "Dump the complete contents of the torrent files.", "FILE");
+	cp.addOption(dumpFileOption);
+
+	QCommandLineOption dumpFormatOption(QStringList() << "dump-format", "The format of the complete dump.", "FORMAT", "text");
+	cp.addOption(dumpFormatOption);
+
 	QCommandLineOption verboseOption(QStringList() << "v" << "verbose", "Turn on verbose reporting.");
 	cp.addOption(verboseOption);
 
@@ -253,35 +194,359 @@ int main(int argc, char *argv[])
 	QCommandLineOption torrentListOption(QStringList() << "l" << "torrent-list", "The 'torrent-source' argument is a text file containing the list of torrents to be verified.");
 	cp.addOption(torrentListOption);
 
-	QCommandLineOption md5Option(QStringList() << "m" << "md5", "Also compute and check MD5 hash checksums for files with names which *look* like and MD5 hash value.");
+	QCommandLineOption md5Option(QStringList() << "m" << "md5", "Also compute and check MD5 hash checksums for files with an 'md5sum' key, or with names which *look* like an MD5 hash value.");
 	cp.addOption(md5Option);
 
 	QCommandLineOption sizeOnlyOption(QStringList() << "z" << "check-size-only", "Only check file sizes, and do not compute torrent checksums.");
 	cp.addOption(sizeOnlyOption);
 
+	QCommandLineOption scanThreadsOption(QStringList() << "scan-threads", "The number of threads checking file sizes.", "N",
+			QString::number(FileSizeScanner::DEFAULT_THREAD_COUNT));
+	cp.addOption(scanThreadsOption);
+
+	QCommandLineOption threadsOption(QStringList() << "t" << "threads", "Compute the SHA1 checksums in N worker threads.", "N", "0");
+	cp.addOption(threadsOption);
+
+	QCommandLineOption jobsOption(QStringList() << "j" << "jobs", "Verify up to N torrents concurrently on each storage device.", "N", "0");
+	cp.addOption(jobsOption);
+
+	QCommandLineOption mmapOption(QStringList() << "mmap", "Memory-map the torrent data files, instead of reading them.");
+	cp.addOption(mmapOption);
+
+	QCommandLineOption ioEngineOption(QStringList() << "io-engine", "Select the data reading backend.", "ENGINE", "sync");
+	cp.addOption(ioEngineOption);
+
+	QCommandLineOption ioDepthOption(QStringList() << "io-depth", "The number of reads kept in flight by the asynchronous read engines.", "N", "4");
+	cp.addOption(ioDepthOption);
+
+	QCommandLineOption directIoOption(QStringList() << "direct-io", "Bypass the page cache when reading data.");
+	cp.addOption(directIoOption);
+
+	QCommandLineOption dropCacheOption(QStringList() << "drop-cache", "Drop the data from the page cache after it has been read.");
+	cp.addOption(dropCacheOption);
+
+	QCommandLineOption maxReadRateOption(QStringList() << "max-read-rate", "Limit the rate of reading the torrent data.", "MBPS");
+	cp.addOption(maxReadRateOption);
+
+	QCommandLineOption adaptiveIoOption(QStringList() << "adaptive-io", "Limit the number of reads in flight by the read latency.");
+	cp.addOption(adaptiveIoOption);
+
+	QCommandLineOption targetLatencyOption(QStringList() << "target-latency", "The target read latency for adaptive reading.", "MS",
+					       QString::number(ReadThrottle::DEFAULT_TARGET_LATENCY_MS));
+	cp.addOption(targetLatencyOption);
+
+	QCommandLineOption ioIdleOption(QStringList() << "io-idle", "Read the data in the idle I/O scheduling class.");
+	cp.addOption(ioIdleOption);
+
+	QCommandLineOption sha1KernelOption(QStringList() << "sha1-kernel", "Select the SHA1 implementation.", "KERNEL", "auto");
+	cp.addOption(sha1KernelOption);
+
+	QCommandLineOption hashVersionOption(QStringList() << "hash-version", "The hashes to verify the torrents with.", "VERSION", "auto");
+	cp.addOption(hashVersionOption);
+
+	QCommandLineOption selfTestOption(QStringList() << "self-test", "Check the SHA1 implementations, and exit.");
+	cp.addOption(selfTestOption);
+
+	QCommandLineOption fullOption(QStringList() << "full", "Verify all data, even if unchanged since the last verification.");
+	cp.addOption(fullOption);
+
+	QCommandLineOption cacheDirOption(QStringList() << "cache-dir", "The directory that holds the verification cache.", "DIR");
+	cp.addOption(cacheDirOption);
+
+	QCommandLineOption resumeOption(QStringList() << "resume", "Resume an interrupted verification run.", "JOURNAL");
+	cp.addOption(resumeOption);
+
+	QCommandLineOption buildCatalogOption(QStringList() << "build-catalog", "Write the metadata of the torrents to a metadata catalog.", "FILE");
+	cp.addOption(buildCatalogOption);
+
+	QCommandLineOption catalogOption(QStringList() << "catalog", "Load the metadata of the torrents from a metadata catalog.", "FILE");
+	cp.addOption(catalogOption);
+
+	QCommandLineOption ownerOfOption(QStringList() << "owner-of", "Print the torrent that holds a data file.", "PATH");
+	cp.addOption(ownerOfOption);
+
+	QCommandLineOption watchOption(QStringList() << "watch", "Watch the torrent data directory, and verify changed data.");
+	cp.addOption(watchOption);
+
+	QCommandLineOption scrubIntervalOption(QStringList() << "scrub-interval", "The interval between background verifications in watch mode.", "HOURS", "24");
+	cp.addOption(scrubIntervalOption);
+
+	QCommandLineOption coordinatorOption(QStringList() << "coordinator", "Hand out shards of the torrents to worker processes.", "ADDRESS");
+	cp.addOption(coordinatorOption);
+
+	QCommandLineOption shardPiecesOption(QStringList() << "shard-pieces", "The number of pieces of a shard of a large torrent.", "N",
+					     QString::number(ShardCoordinator::DEFAULT_SHARD_PIECES));
+	cp.addOption(shardPiecesOption);
+
+	QCommandLineOption workerOption(QStringList() << "worker", "Verify the shards handed out by a coordinator.", "ADDRESS");
+	cp.addOption(workerOption);
+
+	QCommandLineOption partialResultsOption(QStringList() << "partial-results", "The partial result file of a worker.", "FILE");
+	cp.addOption(partialResultsOption);
+
+	QCommandLineOption mergeOption(QStringList() << "merge", "Merge the results recorded in a partial result file.", "FILE");
+	cp.addOption(mergeOption);
+
+	QCommandLineOption sampleOption(QStringList() << "sample", "Only verify a random sample of the pieces of each torrent.", "SPEC");
+	cp.addOption(sampleOption);
+
+	QCommandLineOption sampleSeedOption(QStringList() << "sample-seed", "The seed for selecting the sampled pieces.", "N");
+	cp.addOption(sampleSeedOption);
+
+	QCommandLineOption jsonOption(QStringList() << "json", "Also write the results in JSON lines format.", "FILE");
+	cp.addOption(jsonOption);
+
+	QCommandLineOption metricsOption(QStringList() << "metrics", "Periodically write performance metrics in Prometheus text format.", "TARGET");
+	cp.addOption(metricsOption);
+
+	QCommandLineOption metricsIntervalOption(QStringList() << "metrics-interval", "The interval between metrics dumps.", "SECONDS", "10");
+	cp.addOption(metricsIntervalOption);
+
 	cp.process(application);
 	if (cp.isSet(helpOption))
 	{
 		printUsage();
 		return 0;
 	}
+	if (cp.isSet(selfTestOption))
+		return Sha1::selfTest() ? 0 : 1;
+	if (!Sha1::selectKernel(cp.value(sha1KernelOption)))
+	{
+		qCritical() << "Unsupported SHA1 kernel specified:" << cp.value(sha1KernelOption);
+		printUsage();
+		return 1;
+	}
+
+	const QString hashVersion = cp.value(hashVersionOption);
+	if (hashVersion != "auto" && hashVersion != "1" && hashVersion != "2")
+	{
+		qCritical() << "Unsupported hash version specified:" << hashVersion;
+		printUsage();
+		return 1;
+	}
 
 	const bool verboseFlag = cp.isSet(verboseOption);
 	const bool continueOnErrorsFlag = cp.isSet(continueOption);
 	const bool torrentListFlag = cp.isSet(torrentListOption);
 	const bool checkSizeOnlyFlag = cp.isSet(sizeOnlyOption);
 	const bool dumpOnlyFlag = cp.isSet(dumpOption);
+	const bool buildCatalogFlag = cp.isSet(buildCatalogOption);
 	const bool md5Flag = cp.isSet(md5Option);
+	bool ok;
+	const unsigned hashThreadCount = cp.value(threadsOption).toUInt(& ok);
+	if (!ok)
+	{
+		qCritical() << "Invalid number of threads specified:" << cp.value(threadsOption);
+		printUsage();
+		return 1;
+	}
+	const unsigned jobsPerDevice = cp.value(jobsOption).toUInt(& ok);
+	if (!ok)
+	{
+		qCritical() << "Invalid number of concurrent jobs specified:" << cp.value(jobsOption);
+		printUsage();
+		return 1;
+	}
+	const unsigned scanThreadCount = cp.value(scanThreadsOption).toUInt(& ok);
+	if (!ok || !scanThreadCount)
+	{
+		qCritical() << "Invalid number of scan threads specified:" << cp.value(scanThreadsOption);
+		printUsage();
+		return 1;
+	}
+
+	VerificationOptions verificationOptions;
+	/* Set when torrent processing ends early, to stop the torrents being verified in the background. */
+	std::atomic<bool> verificationCancelled { false };
+	verificationOptions.cancelled = & verificationCancelled;
+	verificationOptions.verbose = verboseFlag;
+	verificationOptions.check_size_only = checkSizeOnlyFlag;
+	verificationOptions.compute_md5_hashes = md5Flag;
+	verificationOptions.hash_thread_count = hashThreadCount;
+	verificationOptions.memory_map_files = cp.isSet(mmapOption);
+	verificationOptions.io_engine = cp.value(ioEngineOption);
+	verificationOptions.hash_version = hashVersion == "auto" ? 0 : hashVersion.toInt();
+	verificationOptions.direct_io = cp.isSet(directIoOption);
+	verificationOptions.drop_cache = cp.isSet(dropCacheOption);
+	verificationOptions.full_verification = cp.isSet(fullOption);
+	const VerificationCache verificationCache(cp.isSet(cacheDirOption) ? cp.value(cacheDirOption) : VerificationCache::defaultDirectory());
+	if (verificationCache.path().isEmpty())
+		qCritical() << "No verification cache directory available, verifying all data.";
+	else
+		verificationOptions.cache = & verificationCache;
+	if (!ReadEngine::engineNames().contains(verificationOptions.io_engine))
+	{
+		qCritical() << "Unsupported read engine specified:" << verificationOptions.io_engine;
+		printUsage();
+		return 1;
+	}
+	verificationOptions.io_queue_depth = cp.value(ioDepthOption).toUInt(& ok);
+	if (!ok || !verificationOptions.io_queue_depth)
+	{
+		qCritical() << "Invalid read queue depth specified:" << cp.value(ioDepthOption);
+		printUsage();
+		return 1;
+	}
+	const double maxReadRate = cp.isSet(maxReadRateOption) ? cp.value(maxReadRateOption).toDouble(& ok) : 0;
+	if (!ok || maxReadRate < 0)
+	{
+		qCritical() << "Invalid maximum read rate specified:" << cp.value(maxReadRateOption);
+		printUsage();
+		return 1;
+	}
+	const unsigned targetLatency = cp.value(targetLatencyOption).toUInt(& ok);
+	if (!ok || !targetLatency)
+	{
+		qCritical() << "Invalid target read latency specified:" << cp.value(targetLatencyOption);
+		printUsage();
+		return 1;
+	}
+	ReadThrottle::instance().configure(maxReadRate * (1 << 20), cp.isSet(adaptiveIoOption), targetLatency,
+					   verificationOptions.io_queue_depth * std::max(jobsPerDevice, 1u));
+	/* Set before any threads are created, so that all of them inherit the I/O priority. */
+	if (cp.isSet(ioIdleOption) && !ReadThrottle::setIdleIoPriority())
+		qCritical() << "Can not set the idle I/O scheduling class, reading the data with the default I/O priority.";
+	if (cp.isSet(sampleOption))
+	{
+		if (!PieceSampler::parse(cp.value(sampleOption), verificationOptions.sample_fraction, verificationOptions.sample_count))
+		{
+			qCritical() << "Invalid sample specified:" << cp.value(sampleOption);
+			printUsage();
+			return 1;
+		}
+		if (md5Flag || checkSizeOnlyFlag)
+		{
+			qCritical() << "Sampling can not be combined with MD5 hash checking, or with only checking file sizes.";
+			printUsage();
+			return 1;
+		}
+		ok = true;
+		verificationOptions.sample_seed = cp.isSet(sampleSeedOption) ? cp.value(sampleSeedOption).toULongLong(& ok) : QDateTime::currentMSecsSinceEpoch();
+		if (!ok)
+		{
+			qCritical() << "Invalid sample seed specified:" << cp.value(sampleSeedOption);
+			printUsage();
+			return 1;
+		}
+	}
+	const bool sampleFlag = cp.isSet(sampleOption) && !dumpOnlyFlag;
+	const bool watchFlag = cp.isSet(watchOption);
+	if (watchFlag && (dumpOnlyFlag || buildCatalogFlag || checkSizeOnlyFlag || jobsPerDevice || sampleFlag || cp.isSet(resumeOption)))
+	{
+		qCritical() << "Watch mode can not be combined with '-d', '--build-catalog', '-z', '-j', '--sample' or '--resume'.";
+		printUsage();
+		return 1;
+	}
+	const double scrubIntervalHours = cp.value(scrubIntervalOption).toDouble(& ok);
+	if (!ok || scrubIntervalHours < 0)
+	{
+		qCritical() << "Invalid scrub interval specified:" << cp.value(scrubIntervalOption);
+		printUsage();
+		return 1;
+	}
+	const bool coordinatorFlag = cp.isSet(coordinatorOption), workerFlag = cp.isSet(workerOption);
+	/* The coordinator merges the partial results of the workers, too. */
+	const bool mergeFlag = cp.isSet(mergeOption) || coordinatorFlag;
+	if ((workerFlag || mergeFlag) && (dumpOnlyFlag || buildCatalogFlag || checkSizeOnlyFlag || jobsPerDevice || sampleFlag || cp.isSet(resumeOption) || watchFlag))
+	{
+		qCritical() << "Sharded verification can not be combined with '-d', '--build-catalog', '-z', '-j', '--sample', '--resume' or '--watch'.";
+		printUsage();
+		return 1;
+	}
+	if (workerFlag && mergeFlag)
+	{
+		qCritical() << "A worker can neither be a coordinator, nor merge results.";
+		printUsage();
+		return 1;
+	}
+	const int64_t shardPieces = cp.value(shardPiecesOption).toLongLong(& ok);
+	if (!ok || shardPieces <= 0)
+	{
+		qCritical() << "Invalid number of shard pieces specified:" << cp.value(shardPiecesOption);
+		printUsage();
+		return 1;
+	}
+	const unsigned metricsInterval = cp.value(metricsIntervalOption).toUInt(& ok);
+	if (!ok || !metricsInterval)
+	{
+		qCritical() << "Invalid metrics interval specified:" << cp.value(metricsIntervalOption);
+		printUsage();
+		return 1;
+	}
+	ResultStream results;
+	if (cp.isSet(jsonOption))
+	{
+		if (!results.open(cp.value(jsonOption)))
+			return 1;
+		verificationOptions.results = & results;
+	}
+	std::unique_ptr<MetricsExporter> metricsExporter;
+	if (cp.isSet(metricsOption))
+		metricsExporter = std::make_unique<MetricsExporter>(cp.value(metricsOption), metricsInterval);
+	const BencodeDumper::Format dumpFormat = cp.value(dumpFormatOption) == "json" ? BencodeDumper::JSON : BencodeDumper::TEXT;
+	if (dumpFormat == BencodeDumper::TEXT && cp.value(dumpFormatOption) != "text")
+	{
+		qCritical() << "Unsupported dump format specified:" << cp.value(dumpFormatOption);
+		printUsage();
+		return 1;
+	}
+	QFile dumpFile;
+	if (cp.isSet(dumpFileOption))
+	{
+		if (cp.value(dumpFileOption) == "-")
+			ok = dumpFile.open(stdout, QFile::WriteOnly);
+		else
+		{
+			dumpFile.setFileName(cp.value(dumpFileOption));
+			ok = dumpFile.open(QFile::WriteOnly | QFile::Truncate);
+		}
+		if (!ok)
+		{
+			qCritical() << "Can not open dump file for writing:" << cp.value(dumpFileOption);
+			return 1;
+		}
+	}
+
+	std::shared_ptr<MetadataCatalog> metadataCatalog;
+	if (cp.isSet(catalogOption))
+	{
+		metadataCatalog = std::make_shared<MetadataCatalog>(cp.value(catalogOption));
+		if (!metadataCatalog->open())
+			return 1;
+	}
+	if (cp.isSet(ownerOfOption))
+	{
+		if (!metadataCatalog)
+		{
+			qCritical() << "Finding the torrent that holds a data file requires a metadata catalog ('--catalog').";
+			printUsage();
+			return 1;
+		}
+		bool found = true;
+		for (QString path : cp.values(ownerOfOption))
+		{
+			while (path.startsWith("./"))
+				path.remove(0, 2);
+			int file_index;
+			const int record = metadataCatalog->owner(path, file_index);
+			if (record == -1)
+				qCritical().noquote() << path << ": not found in the metadata catalog";
+			else
+				qInfo().noquote() << QString("%1\t%2\t%3").arg(path).arg(metadataCatalog->torrentFileName(record)).arg(file_index);
+			found &= record != -1;
+		}
+		return found ? 0 : 1;
+	}
 
 	/* Validate arguments. */
-	if (!dumpOnlyFlag && cp.positionalArguments().length() != 2)
+	if (!dumpOnlyFlag && !buildCatalogFlag && cp.positionalArguments().length() != 2)
 	{
 		qCritical() << "Invalid arguments, need to specify both a torrent directory, and a torrent source (either a torrent file name, or a file containing a list of torrents).";
 		qCritical() << "";
 		printUsage();
 		return 1;
 	}
-	else if (dumpOnlyFlag && cp.positionalArguments().length() != 1)
+	else if ((dumpOnlyFlag || buildCatalogFlag) && cp.positionalArguments().length() != 1)
 	{
 		qCritical() << "Invalid arguments, need to specify a torrent source (either a torrent file name, or a file containing a list of torrents).";
 		qCritical() << "";
@@ -289,8 +554,8 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	const QString torrent_data_directory = (dumpOnlyFlag ? "" : cp.positionalArguments().at(0));
-	const QString torrent_source = cp.positionalArguments().at(dumpOnlyFlag ? 0 : 1);
+	const QString torrent_data_directory = (dumpOnlyFlag || buildCatalogFlag ? "" : cp.positionalArguments().at(0));
+	const QString torrent_source = cp.positionalArguments().at(dumpOnlyFlag || buildCatalogFlag ? 0 : 1);
 
 	/* Build the list of torrents to be verified. */
 	QStringList torrent_files;
@@ -315,43 +580,152 @@ int main(int argc, char *argv[])
 		/* Verify a single torrent specified on the command line. */
 		torrent_files << torrent_source;
 
-	QList<TorrentCheckResult> checkResults;
-
-	struct
+	if (buildCatalogFlag)
 	{
-		unsigned file_count = 0;
-		uint64_t total_data_length = 0;
+		/* Parse all torrents, and write the metadata catalog. Torrents which fail to load are reported, and left out. */
+		QElapsedTimer buildTimer;
+		buildTimer.start();
+		TorrentCatalog catalog(torrent_files, 0);
+		MetadataCatalog::Builder builder;
+		int failed_count = 0;
+		for (int i = 0; i < torrent_files.length(); i ++)
+		{
+			std::shared_ptr<const BitTorrent> t = catalog.wait(i);
+			if (!t)
+			{
+				qCritical().noquote() << "Failed to process file" << torrent_files.at(i) << "as a torrent file.";
+				failed_count ++;
+			}
+			else if (!builder.add(torrent_files.at(i), * t) && verboseFlag)
+				qInfo().noquote() << "Not cataloging v2 torrent:" << torrent_files.at(i);
+		}
+		if (!builder.write(cp.value(buildCatalogOption)))
+			return 1;
+		qInfo().noquote() << QString("Cataloged %1 of %2 torrents in %3 seconds.")
+				     .arg(builder.count()).arg(torrent_files.length()).arg(buildTimer.elapsed() / 1000., 0, 'f', 2);
+		return failed_count ? 1 : 0;
 	}
-	torrent_statistics;
 
-	/* Compute total number of files and total data length of the files in all torrents,
-	 * in order to be able to print percentage statistics during processing. */
-	for (const auto & torrent_file : torrent_files)
+	QList<TorrentCheckResult> checkResults;
+
+	/* Load all torrents in the background, in parallel. The catalog also provides the total number of files and
+	 * the total data length of the files in all torrents, in order to be able to print percentage statistics during processing. */
+	TorrentCatalog catalog(torrent_files, 0, metadataCatalog);
+
+	QElapsedTimer timer;
+	timer.start();
+	const QString runTimestamp = QDateTime::currentDateTime().toString("ddMMyyyy-hhmmss");
+	const QByteArray logFileLineDelimiter = "-----------------------------------------------\n";
+
+	/* Resuming an interrupted run - make sure that the run verifies the same torrents. */
+	QString journalFileName = QString("torrent-check-journal-%1.txt").arg(runTimestamp);
+	std::map<int, CheckpointJournal::TorrentState> resumedStates;
+	if (cp.isSet(resumeOption) && !dumpOnlyFlag)
 	{
-		BitTorrent t(torrent_file);
-		if (!t.parse())
+		journalFileName = cp.value(resumeOption);
+		QString journalDataDirectory;
+		if (!CheckpointJournal::load(journalFileName, journalDataDirectory, resumedStates))
+			return 1;
+		if (journalDataDirectory != torrent_data_directory)
 		{
-			qCritical().noquote() << "Failed to process file" << torrent_file << "as a torrent file.";
-			return -1;
+			qCritical() << "The checkpoint journal is for a different torrent data directory:" << journalDataDirectory;
+			return 1;
 		}
-		if (!t.torrent_details.files.length())
+		for (const auto & s : resumedStates)
+			if (s.first < 0 || s.first >= torrent_files.length() || s.second.torrent_file != torrent_files.at(s.first))
+			{
+				qCritical() << "The checkpoint journal does not match the list of torrents to verify:" << s.second.torrent_file;
+				return 1;
+			}
+	}
+	if (workerFlag)
+	{
+		/* Worker mode - verify the shards handed out by the coordinator, one at a time, and record their results. */
+		PartialResults partialResults;
+		if (!partialResults.open(cp.isSet(partialResultsOption) ? cp.value(partialResultsOption)
+					 : QString("torrent-check-partial-%1-%2.txt").arg(runTimestamp).arg(QCoreApplication::applicationPid()), torrent_data_directory))
+			return 1;
+		ShardWorker worker(torrent_files);
+		if (!worker.connect(cp.value(workerOption), QFileInfo(partialResults.fileName()).absoluteFilePath()))
+			return 1;
+		int shard_id = -1, shard_count = 0;
+		ShardCoordinator::Shard shard;
+		while (worker.next(shard_id, shard_id, shard))
 		{
-			torrent_statistics.total_data_length += t.torrent_details.length;
-			torrent_statistics.file_count ++;
+			if (shard_id == -1)
+			{
+				qInfo().noquote() << QString("All shards have been verified, %1 of them by this worker. Results recorded in: %2")
+						     .arg(shard_count).arg(partialResults.fileName());
+				return 0;
+			}
+			const QString & torrent_file = torrent_files.at(shard.torrent_index);
+			qInfo().noquote() << "Processing torrent:" << torrent_file
+					  << (shard.last_piece == -1 ? QString("(all pieces)") : QString("(pieces %1-%2)").arg(shard.first_piece).arg(shard.last_piece));
+			TorrentCheckResult checkResult(torrent_file);
+			bool verified = false;
+			const std::shared_ptr<const BitTorrent> t = catalog.wait(shard.torrent_index);
+			if (!t)
+				qCritical().noquote() << "Failed to process file" << torrent_file << "as a torrent file.";
+			else
+			{
+				std::vector<int64_t> pieces;
+				for (int64_t piece_index = shard.first_piece; piece_index <= shard.last_piece; piece_index ++)
+					pieces.push_back(piece_index);
+				VerificationOptions shardOptions = verificationOptions;
+				shardOptions.piece_selection = shard.last_piece == -1 ? 0 : & pieces;
+				verified = verify_torrent_hashes(torrent_data_directory, * t, shardOptions, checkResult);
+			}
+			(verified ? Metrics::instance().torrents_verified : Metrics::instance().torrents_failed) ++;
+			if (!verified)
+				qCritical().noquote() << "Error processing torrent:" << torrent_file;
+			if (!partialResults.record(shard, checkResult, verified))
+			{
+				qCritical() << "Can not write partial result file:" << partialResults.fileName();
+				return 1;
+			}
+			shard_count ++;
 		}
-		else
+		return 1;
+	}
+
+	QStringList partialResultFiles = cp.values(mergeOption);
+	if (coordinatorFlag)
+	{
+		/* Coordinator mode - hand out the shards of the torrents to the workers, and wait until all have been verified. */
+		std::vector<int64_t> pieceCounts;
+		for (int i = 0; i < torrent_files.length(); i ++)
 		{
-			for (const auto & file : t.torrent_details.files)
-				torrent_statistics.total_data_length += file.length;
-			torrent_statistics.file_count += t.torrent_details.files.count();
+			const std::shared_ptr<const BitTorrent> t = catalog.wait(i);
+			/* Torrents verified only with their v2 hashes, and torrents which fail to load, are not split. */
+			pieceCounts.push_back(t && selectsV1Pieces(* t, verificationOptions) ? t->pieceCount() : 0);
 		}
+		ShardCoordinator coordinator(torrent_files, ShardCoordinator::split(pieceCounts, shardPieces));
+		if (!coordinator.listen(cp.value(coordinatorOption)))
+			return 1;
+		qInfo().noquote() << QString("Verifying %1 torrents in %2 shards, waiting for worker processes at: %3")
+				     .arg(torrent_files.length()).arg(coordinator.shardCount()).arg(cp.value(coordinatorOption));
+		if (!coordinator.run())
+			return 1;
+		partialResultFiles << coordinator.partialResultFiles();
 	}
+	PartialResults partialResults;
+	for (const auto & f : partialResultFiles)
+		if (!partialResults.load(f, torrent_data_directory))
+			return 1;
+	for (const auto & r : partialResults.results())
+		if (r.first < 0 || r.first >= torrent_files.length() || r.second.torrent_file != torrent_files.at(r.first))
+		{
+			qCritical() << "The partial results do not match the list of torrents to verify:" << r.second.torrent_file;
+			return 1;
+		}
 
-	QElapsedTimer timer;
-	timer.start();
-	const QByteArray logFileLineDelimiter = "-----------------------------------------------\n";
+	CheckpointJournal journal;
+	/* Watch mode does not record checkpoints, as it does not verify a list of torrents from start to end,
+	 * and neither does merging partial results, which verifies nothing. */
+	if (!dumpOnlyFlag && !watchFlag && !mergeFlag && !journal.open(journalFileName, torrent_data_directory, resumedStates))
+		return 1;
 
-	QFile logFile(QString("torrent-check-log-%1.txt").arg(QDateTime::currentDateTime().toString("ddMMyyyy-hhmmss")));
+	QFile logFile(QString("torrent-check-log-%1.txt").arg(runTimestamp));
 	if (!logFile.open(QFile::WriteOnly))
 	{
 		qCritical().noquote() << "Can not open log file for writing:" << logFile.fileName();
@@ -366,13 +740,258 @@ int main(int argc, char *argv[])
 			cmdline += QString(argv[i]) + ' ';
 		logFile.write(QString("Command line:\n%1\n").arg(cmdline).toLocal8Bit());
 	}
+	if (mergeFlag)
+	{
+		logFile.write("Merged partial result files:\n");
+		for (const auto & f : partialResultFiles)
+			logFile.write((f + '\n').toLocal8Bit());
+	}
+	else if (!dumpOnlyFlag && !watchFlag)
+	{
+		logFile.write(QString("Checkpoint journal: %1\n").arg(journalFileName).toLocal8Bit());
+		if (resumedStates.size())
+			qInfo().noquote() << "Resuming the verification run recorded in:" << journalFileName;
+	}
+	if (sampleFlag)
+	{
+		const QString s = QString("Verifying a sample of %1 of the pieces of each torrent, sample seed: %2")
+				.arg(verificationOptions.sample_fraction ? QString("%1 %").arg(verificationOptions.sample_fraction * 100.) : QString::number(verificationOptions.sample_count))
+				.arg(verificationOptions.sample_seed);
+		qInfo().noquote() << s;
+		logFile.write((s + '\n').toLocal8Bit());
+	}
 	logFile.write(logFileLineDelimiter);
 	logFile.write("Verifying torrents:\n");
 	logFile.write(logFileLineDelimiter);
 	logFile.flush();
 
-	for (const auto & torrent_file : torrent_files)
+	/* Verifies a torrent, and records the progress in the checkpoint journal. When resuming, a completed torrent is not
+	 * verified again, and the results are those recorded in the journal. Called concurrently, when verifying torrents concurrently. */
+	std::function<bool(int torrent_index, const BitTorrent & t, TorrentCheckResult & checkResult)> verifyTorrent =
+			[&] (int torrent_index, const BitTorrent & t, TorrentCheckResult & checkResult) -> bool {
+		CheckpointJournal::TorrentState state;
+		if (resumedStates.count(torrent_index))
+			state = resumedStates.at(torrent_index);
+		checkResult.corrupted_files_by_sha1_checksum = state.sha1_failures;
+		checkResult.corrupted_files_by_sha256_checksum = state.sha256_failures;
+		checkResult.corrupted_files_by_md5_checksum = state.md5_failures;
+		if (state.done)
+			return state.ok;
+		journal.started(torrent_index, torrent_files.at(torrent_index));
+		bool ok = verify_torrent_hashes(torrent_data_directory, t, verificationOptions, checkResult, state.next_piece, [&] (int64_t next_piece) -> void {
+			journal.progress(torrent_index, next_piece, checkResult.corrupted_files_by_sha1_checksum, checkResult.corrupted_files_by_sha256_checksum,
+					checkResult.corrupted_files_by_md5_checksum);
+		});
+		/* A cancelled verification is not recorded as completed, so that a resumed run resumes it. */
+		if (verificationCancelled)
+			return false;
+		/* Failures found before the verification was interrupted. */
+		ok &= !state.sha1_failures.length() && !state.sha256_failures.length() && !state.md5_failures.length();
+		(ok ? Metrics::instance().torrents_verified : Metrics::instance().torrents_failed) ++;
+		journal.finished(torrent_index, ok, checkResult.corrupted_files_by_sha1_checksum, checkResult.corrupted_files_by_sha256_checksum,
+				checkResult.corrupted_files_by_md5_checksum);
+		return ok;
+	};
+
+	/* Takes the results of a torrent from the merged partial results. A torrent, of which not all shards have been verified, fails. */
+	std::function<bool(int torrent_index, TorrentCheckResult & checkResult)> mergedResult = [&] (int torrent_index, TorrentCheckResult & checkResult) -> bool {
+		const auto r = partialResults.results().find(torrent_index);
+		if (r == partialResults.results().end() || !r->second.complete())
+		{
+			const QString s = r == partialResults.results().end() ? QString("%1\t: ERROR, no results recorded").arg(torrent_files.at(torrent_index))
+					: QString("%1\t: ERROR, incomplete results, %2 of %3 shards verified").arg(torrent_files.at(torrent_index))
+					  .arg(r->second.shards.size()).arg(r->second.shard_count);
+			qCritical().noquote() << s;
+			logFile.write((s + '\n').toLocal8Bit());
+		}
+		if (r == partialResults.results().end())
+			return false;
+		checkResult.corrupted_files_by_sha1_checksum = r->second.sha1_failures;
+		checkResult.corrupted_files_by_sha256_checksum = r->second.sha256_failures;
+		checkResult.corrupted_files_by_md5_checksum = r->second.md5_failures;
+		checkResult.hashed_length = r->second.hashed_length;
+		checkResult.elapsed_ms = r->second.elapsed_ms;
+		return r->second.ok && r->second.complete();
+	};
+
+	/* When only checking file sizes, check the files of all torrents up front, in a single bulk scan.
+	 * Torrents which fail to load are skipped here, and reported below. */
+	FileSizeScanner sizeScanner;
+	if (checkSizeOnlyFlag && !dumpOnlyFlag)
+	{
+		for (int i = 0; i < torrent_files.length(); i ++)
+		{
+			std::shared_ptr<const BitTorrent> t = catalog.wait(i);
+			if (t)
+				for (const auto & f : torrentDataFiles(torrent_data_directory, * t))
+					if (!f.padding)
+						sizeScanner.add(f.name);
+		}
+		QElapsedTimer scanTimer;
+		scanTimer.start();
+		sizeScanner.scan(scanThreadCount);
+		qInfo().noquote() << QString("Checked %1 files in %2 directories in %3 seconds.")
+				     .arg(sizeScanner.fileCount()).arg(sizeScanner.directoryCount()).arg(scanTimer.elapsed() / 1000., 0, 'f', 2);
+		verificationOptions.size_scan = & sizeScanner;
+	}
+
+	if (watchFlag)
+	{
+		/* Watch mode - map the data files of all torrents to their pieces, and verify the pieces of files as they change,
+		 * and all torrents periodically, until terminated. */
+		std::vector<std::shared_ptr<const BitTorrent>> torrents;
+		std::vector<int64_t> pieceCounts;
+		struct WatchedFile
+		{
+			int torrent_index;
+			int64_t first_piece, last_piece;
+		};
+		std::unordered_map<std::string, WatchedFile> watchedFiles;
+		for (int i = 0; i < torrent_files.length(); i ++)
+		{
+			std::shared_ptr<const BitTorrent> t = catalog.wait(i);
+			if (!t)
+			{
+				qCritical().noquote() << "Failed to process file" << torrent_files.at(i) << "as a torrent file.";
+				return -1;
+			}
+			torrents.push_back(t);
+			/* Torrents verified only with their v2 hashes are verified as a whole. */
+			pieceCounts.push_back(selectsV1Pieces(* t, verificationOptions) ? t->pieceCount() : 0);
+			const uint64_t piece_length = t->torrent_details.piece_length;
+			uint64_t offset = 0;
+			for (const auto & f : torrentDataFiles(torrent_data_directory, * t))
+			{
+				if (!f.padding && f.size)
+					watchedFiles[QDir::cleanPath(f.name).toStdString()] = WatchedFile { i, (int64_t) (offset / piece_length), (int64_t) ((offset + f.size - 1) / piece_length) };
+				offset += f.size;
+			}
+		}
+		DataWatcher watcher;
+		if (!watcher.start(QDir::cleanPath(torrent_data_directory)))
+			return 1;
+		{
+			const QString s = QString("Watching %1 directories for changes of %2 data files of %3 torrents.")
+					.arg(watcher.directoryCount()).arg(watchedFiles.size()).arg(torrent_files.length());
+			qInfo().noquote() << s;
+			logFile.write((s + '\n').toLocal8Bit());
+			logFile.flush();
+		}
+
+		WatchScheduler watchScheduler(pieceCounts);
+		QElapsedTimer clock;
+		clock.start();
+		const int64_t scrub_interval_ms = scrubIntervalHours * 3600 * 1000;
+		int64_t next_scrub_ms = scrub_interval_ms;
+		while (1)
+		{
+			if (scrub_interval_ms && clock.elapsed() >= next_scrub_ms)
+			{
+				watchScheduler.scrubAll();
+				next_scrub_ms += scrub_interval_ms;
+				logFile.write(QString("%1\tStarting a background verification of all torrents\n").arg(QDateTime::currentDateTime().toString("dd/MM/yyyy, hh:mm:ss")).toLocal8Bit());
+				logFile.flush();
+			}
+			/* Wait for changes until the next job is due - or only check for changes, if a job is due already. */
+			int64_t timeout_ms = watchScheduler.nextDueMs(clock.elapsed());
+			if (scrub_interval_ms)
+				timeout_ms = std::max(timeout_ms == -1 ? next_scrub_ms - clock.elapsed() : std::min(timeout_ms, next_scrub_ms - clock.elapsed()), (int64_t) 0);
+			bool overflowed;
+			for (const auto & path : watcher.wait(std::min(timeout_ms, (int64_t) 3600 * 1000), overflowed))
+			{
+				const auto f = watchedFiles.find(path.toStdString());
+				if (f != watchedFiles.end())
+					watchScheduler.changed(f->second.torrent_index, f->second.first_piece, f->second.last_piece, clock.elapsed());
+			}
+			if (overflowed)
+			{
+				/* Changes may have been missed - verify everything. */
+				qInfo() << "Too many changes, some have been missed - verifying all torrents.";
+				watchScheduler.scrubAll();
+			}
+
+			WatchScheduler::Job job;
+			if (!watchScheduler.next(clock.elapsed(), job))
+				continue;
+			const QString & torrent_file = torrent_files.at(job.torrent_index);
+			const QString what = QString("%1, %2").arg(job.priority == WatchScheduler::CHANGED_DATA ? "changed data" : "background verification")
+					.arg(job.pieces.size() ? QString("%1 pieces").arg(job.pieces.size()) : QString("all pieces"));
+			qInfo().noquote() << "Processing torrent:" << torrent_file << '(' + what + ')';
+			VerificationOptions jobOptions = verificationOptions;
+			jobOptions.piece_selection = job.pieces.size() ? & job.pieces : 0;
+			TorrentCheckResult checkResult(torrent_file);
+			const bool verified = verify_torrent_hashes(torrent_data_directory, * torrents.at(job.torrent_index), jobOptions, checkResult);
+			(verified ? Metrics::instance().torrents_verified : Metrics::instance().torrents_failed) ++;
+			if (results.isOpen())
+				results.torrent(torrent_file, torrents.at(job.torrent_index)->torrent_details.info_hash, verified, checkResult.corrupted_files_by_sha1_checksum,
+						checkResult.corrupted_files_by_sha256_checksum, checkResult.corrupted_files_by_md5_checksum,
+						checkResult.hashed_length, checkResult.elapsed_ms / 1000.);
+			QString s = QString("%1\t%2\t: %3 (%4)").arg(QDateTime::currentDateTime().toString("dd/MM/yyyy, hh:mm:ss")).arg(torrent_file).arg(verified ? "OK" : "ERROR!!!").arg(what);
+			if (checkResult.corrupted_files_by_sha1_checksum.length())
+				s += QString(", corrupted files in torrent, SHA1 hash mismatch: %1").arg(checkResult.corrupted_files_by_sha1_checksum.join(", "));
+			if (checkResult.corrupted_files_by_sha256_checksum.length())
+				s += QString(", corrupted files in torrent, SHA-256 hash mismatch: %1").arg(checkResult.corrupted_files_by_sha256_checksum.join(", "));
+			if (checkResult.corrupted_files_by_md5_checksum.length())
+				s += QString(", corrupted files in torrent, MD5 hash mismatch: %1").arg(checkResult.corrupted_files_by_md5_checksum.join(", "));
+			if (!verified)
+				qCritical().noquote() << s;
+			logFile.write((s + '\n').toLocal8Bit());
+			logFile.flush();
+		}
+	}
+
+	/* If concurrent verification is requested, start verifying all torrents in the background right away.
+	 * The results are still collected, reported and logged below strictly in list order. */
+	std::vector<TorrentCheckResult> scheduledResults;
+	std::vector<char> scheduledResultOk(torrent_files.length(), false);
+	std::unique_ptr<TorrentScheduler> scheduler;
+	std::thread schedulerFeeder;
+	if (jobsPerDevice && !dumpOnlyFlag)
 	{
+		scheduledResults.reserve(torrent_files.length());
+		for (const auto & torrent_file : torrent_files)
+			scheduledResults.emplace_back(torrent_file);
+		scheduler = std::make_unique<TorrentScheduler>(jobsPerDevice, torrent_files.length());
+		/* Submit the torrents in list order, as soon as they are loaded. */
+		schedulerFeeder = std::thread([&] (void) -> void {
+			for (int i = 0; i < torrent_files.length(); i ++)
+			{
+				std::shared_ptr<const BitTorrent> t = catalog.wait(i);
+				if (!t)
+					break;
+				scheduler->submit(i, TorrentScheduler::deviceId(torrent_data_directory + '/' + t->torrent_details.name), [&, i, t] (void) -> void {
+					scheduledResultOk[i] = verifyTorrent(i, * t, scheduledResults[i]);
+				});
+			}
+		});
+	}
+	/* Stops background loading and verification - when torrent processing ends early, any remaining work is skipped. */
+	std::function<void(void)> stopBackgroundWork = [&] (void) -> void {
+		catalog.cancel();
+		if (schedulerFeeder.joinable())
+			schedulerFeeder.join();
+		if (scheduler)
+		{
+			scheduler->cancel();
+			verificationCancelled = true;
+		}
+	};
+
+	for (int torrent_index = 0; torrent_index < torrent_files.length(); torrent_index ++)
+	{
+		const QString & torrent_file = torrent_files.at(torrent_index);
+		const std::shared_ptr<const BitTorrent> torrent = catalog.wait(torrent_index);
+		if (!torrent)
+		{
+			qCritical().noquote() << "Failed to process file" << torrent_file << "as a torrent file.";
+			logFile.write(QString("%1\t: ERROR, failed to process the torrent file\n").arg(torrent_file).toLocal8Bit());
+			if (results.isOpen())
+				results.torrent(torrent_file, QByteArray(), false, QStringList(), QStringList(), QStringList(), 0, 0);
+			stopBackgroundWork();
+			return -1;
+		}
+		/* The totals are exact once the whole catalog has been loaded. */
+		const TorrentCatalog::Statistics torrent_statistics = catalog.statistics();
 		qInfo() << "----------------------------------------------------";
 		qInfo().noquote() << "Processing torrent file:" << torrent_file
 			<< QString(": %1 files out of %2 (%3 %),")
@@ -381,15 +1000,27 @@ int main(int argc, char *argv[])
 			   .arg(total_length).arg(torrent_statistics.total_data_length).arg(((double) total_length * 100.) / torrent_statistics.total_data_length, 0, 'f', 2)
 			<< QString("%1 seconds (%2 hours) elapsed")
 			   .arg(timer.elapsed() / 1000).arg((double) timer.elapsed() / (3600 * 1000), 0, 'f', 2);
-		BitTorrent t(torrent_file);
-		if (!t.parse())
-		{
-			qCritical().noquote() << "Failed to process file" << torrent_file << "as a torrent file.";
-			return -1;
-		}
+		const BitTorrent & t = * torrent;
 		qInfo() << "Processing torrent:" << torrent_file;
 		if (dumpOnlyFlag)
+		{
 			logFile.write(QString("Processing torrent: %1\n").arg(torrent_file).toLocal8Bit());
+			QString s = QString("Info hash: %1").arg(QString(t.torrent_details.info_hash.toHex()));
+			qInfo().noquote() << s;
+			logFile.write((s + '\n').toLocal8Bit());
+			if (t.torrent_details.info_hash_v2.length())
+			{
+				s = QString("Info hash (v2): %1").arg(QString(t.torrent_details.info_hash_v2.toHex()));
+				qInfo().noquote() << s;
+				logFile.write((s + '\n').toLocal8Bit());
+			}
+		}
+		else if (verboseFlag)
+		{
+			qInfo().noquote() << "Info hash:" << t.torrent_details.info_hash.toHex();
+			if (t.torrent_details.info_hash_v2.length())
+				qInfo().noquote() << "Info hash (v2):" << t.torrent_details.info_hash_v2.toHex();
+		}
 		if (!t.torrent_details.files.length())
 		{
 			if (dumpOnlyFlag)
@@ -430,18 +1061,62 @@ int main(int argc, char *argv[])
 				qInfo() << "Number of files in torrent:" << t.torrent_details.files.length();
 			}
 			for (const auto & file : t.torrent_details.files)
-				l += file.length;
+				if (!file.padding)
+				{
+					l += file.length;
+					total_file_count ++;
+				}
 			if (verboseFlag)
 				qInfo() << "Total data size:" << l << "bytes," << (double) l / (1024 * 1024 * 1024) << "gigabytes";
 			total_length += l;
-			total_file_count += t.torrent_details.files.count();
 		}
 		total_torrents_processed ++;
+		if (dumpFile.isOpen())
+		{
+			/* In text format, each torrent dump is preceded by the torrent file name; in JSON format, each torrent is
+			 * a JSON object on its own line. */
+			if (dumpFormat == BencodeDumper::JSON)
+			{
+				QJsonObject header;
+				header["torrent"] = torrent_file;
+				QByteArray s = QJsonDocument(header).toJson(QJsonDocument::Compact);
+				/* Remove the closing brace, the contents follow. */
+				s.chop(1);
+				dumpFile.write(s + ",\"content\":");
+			}
+			else
+				dumpFile.write(("Torrent file: " + torrent_file + '\n').toUtf8());
+			if (!t.dump(dumpFile, dumpFormat))
+			{
+				qCritical() << "Can not dump torrent file:" << torrent_file;
+				stopBackgroundWork();
+				return -1;
+			}
+			dumpFile.write(dumpFormat == BencodeDumper::JSON ? "}\n" : "\n");
+		}
 		if (!dumpOnlyFlag)
 		{
 			TorrentCheckResult checkResult(torrent_file);
+			bool verified;
+			if (scheduler)
+			{
+				scheduler->wait(torrent_index);
+				checkResult = scheduledResults.at(torrent_index);
+				verified = scheduledResultOk.at(torrent_index);
+			}
+			else if (mergeFlag)
+				verified = mergedResult(torrent_index, checkResult);
+			else
+				verified = verifyTorrent(torrent_index, t, checkResult);
+			total_piece_count += checkResult.piece_count;
+			total_sampled_pieces += checkResult.sampled_pieces;
+			total_corrupted_sampled_pieces += checkResult.corrupted_sampled_pieces;
+			if (results.isOpen())
+				results.torrent(torrent_file, t.torrent_details.info_hash, verified, checkResult.corrupted_files_by_sha1_checksum,
+						checkResult.corrupted_files_by_sha256_checksum, checkResult.corrupted_files_by_md5_checksum,
+						checkResult.hashed_length, checkResult.elapsed_ms / 1000.);
 
-			if (!verify_torrent_hashes(torrent_data_directory, t, verboseFlag, checkSizeOnlyFlag, md5Flag, checkResult))
+			if (!verified)
 			{
 				checkResults << checkResult;
 				qCritical() << "Error processing torrent:" << torrent_file;
@@ -454,6 +1129,14 @@ int main(int argc, char *argv[])
 						      .arg(checkResult.corrupted_files_by_sha1_checksum.join(", "))
 						      .toLocal8Bit());
 				}
+				if (checkResult.corrupted_files_by_sha256_checksum.length())
+				{
+					qCritical() << "Corrupted files in torrent, SHA-256 hash mismatch:" << checkResult.corrupted_files_by_sha256_checksum.join(", ");
+					logFile.write(QString("%1\t: ERROR, corrupted files in torrent, SHA-256 hash mismatch: %2\n")
+						      .arg(torrent_file)
+						      .arg(checkResult.corrupted_files_by_sha256_checksum.join(", "))
+						      .toLocal8Bit());
+				}
 				if (checkResult.corrupted_files_by_md5_checksum.length())
 				{
 					qCritical() << "Corrupted files in torrent, MD5 hash mismatch:" << checkResult.corrupted_files_by_md5_checksum.join(", ");
@@ -465,6 +1148,7 @@ int main(int argc, char *argv[])
 				if (!continueOnErrorsFlag)
 				{
 					qCritical() << "Aborting torrent processing.";
+					stopBackgroundWork();
 					break;
 				}
 				logFile.write(logFileLineDelimiter);
@@ -476,6 +1160,7 @@ int main(int argc, char *argv[])
 
 		logFile.flush();
 	}
+	stopBackgroundWork();
 	logFile.write(logFileLineDelimiter);
 	logFile.write("\n\n");
 	qInfo() << "";
@@ -503,6 +1188,16 @@ int main(int argc, char *argv[])
 					logFile.write(QString("\t%1\n").arg(f).toLocal8Bit());
 				}
 			}
+			if (t.corrupted_files_by_sha256_checksum.length())
+			{
+				qCritical().noquote() << "\tSHA-256 corrupted files:";
+				logFile.write("\tSHA-256 corrupted files:\n");
+				for (const auto & f : t.corrupted_files_by_sha256_checksum)
+				{
+					qCritical().noquote() << "\t" << f;
+					logFile.write(QString("\t%1\n").arg(f).toLocal8Bit());
+				}
+			}
 			if (t.corrupted_files_by_md5_checksum.length())
 			{
 				qCritical().noquote() << "\tMD5 corrupted files:";
@@ -547,9 +1242,29 @@ int main(int argc, char *argv[])
 
 	qint64 elapsed_time_ms = timer.elapsed();
 
+	if (sampleFlag)
+	{
+		const QString s = QString("Verified a sample of %1 out of %2 pieces, %3 corrupted. The rate of corrupted pieces is at most %4 % (with 95 % confidence).")
+				.arg(total_sampled_pieces).arg(total_piece_count).arg(total_corrupted_sampled_pieces)
+				.arg(PieceSampler::corruptionRateUpperBound(total_sampled_pieces, total_corrupted_sampled_pieces, .95) * 100., 0, 'g', 3);
+		qInfo().noquote() << s;
+		logFile.write((s + '\n').toLocal8Bit());
+	}
+
+	if (metadataCatalog)
+	{
+		const QString s = QString("Loaded the metadata of %1 of %2 torrents from the metadata catalog.")
+				.arg(catalog.statistics().cataloged_count).arg(torrent_files.length());
+		qInfo().noquote() << s;
+		logFile.write((s + '\n').toLocal8Bit());
+	}
 	if (!dumpOnlyFlag)
 		qInfo().noquote() << QString("%1 seconds (%2 hours) elapsed")
 				     .arg(elapsed_time_ms / 1000).arg((double) elapsed_time_ms / (3600 * 1000), 0, 'f', 2);
+	const uint64_t throttled_ms = Metrics::instance().read_throttled_ns / 1000000;
+	if (!dumpOnlyFlag && ReadThrottle::instance().isActive())
+		qInfo().noquote() << QString("Average data read rate: %1 megabytes/second, throttled for %2 seconds")
+				     .arg(((double) total_length / elapsed_time_ms) * 1000. / (1024 * 1024), 0, 'f', 2).arg(throttled_ms / 1000., 0, 'f', 2);
 	logFile.write(QString("Total torrents processed: %1 (%2 corrupted)\n").arg(total_torrents_processed).arg(checkResults.length()).toLocal8Bit());
 	logFile.write(QString("Total file count: %1\n").arg(total_file_count).toLocal8Bit());
 	logFile.write(QString("Total data size: %1 bytes, %2 gigabytes, %3 terabytes\n")
@@ -561,8 +1276,11 @@ int main(int argc, char *argv[])
 			      .arg(elapsed_time_ms / 1000)
 			      .arg((double) elapsed_time_ms / (3600 * 1000), 0, 'f', 2).toLocal8Bit());
 	if (!dumpOnlyFlag)
-		logFile.write(QString("Average data read rate: %1 megabytes/second\n")
-			      .arg(((double) total_length / elapsed_time_ms) * 1000. / (1024 * 1024), 0, 'f', 2).toLocal8Bit());
+		logFile.write(QString("Average data read rate: %1 megabytes/second (read engine: %2, SHA1 kernel: %3%4)\n")
+			      .arg(((double) total_length / elapsed_time_ms) * 1000. / (1024 * 1024), 0, 'f', 2)
+			      .arg(verificationOptions.memory_map_files ? QString("mmap") : verificationOptions.io_engine)
+			      .arg(Sha1::kernelName())
+			      .arg(throttledTimeNote(throttled_ms)).toLocal8Bit());
 	logFile.close();
 	return 0;
 }
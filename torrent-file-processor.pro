@@ -18,7 +18,28 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
-    BitTorrent.hxx
+    Bencode.hxx \
+    BitTorrent.hxx \
+    CheckpointJournal.hxx \
+    DataWatcher.hxx \
+    FileSizeScanner.hxx \
+    MerkleTree.hxx \
+    MetadataCatalog.hxx \
+    Metrics.hxx \
+    PartialResults.hxx \
+    PieceHashPipeline.hxx \
+    PieceReader.hxx \
+    PieceSampler.hxx \
+    ReadEngine.hxx \
+    ReadThrottle.hxx \
+    ResultStream.hxx \
+    ShardCoordinator.hxx \
+    Sha1.hxx \
+    TorrentCatalog.hxx \
+    TorrentScheduler.hxx \
+    TorrentVerifier.hxx \
+    VerificationCache.hxx \
+    WatchScheduler.hxx
 
 RESOURCES += \
     resources.qrc